@@ -0,0 +1,55 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../thermistor.h"
+
+#define ITERATIONS 10000000
+
+double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// The per-sample conversion the clients did before the lookup tables.
+float formula_temperature(int raw, int fahrenheit) {
+    double R = 4095.0/raw-1.0;
+    double celcius = 1.0/(log(R)/THERMISTOR_DEFAULT_BETA+1/298.15)-273.15;
+    return fahrenheit ? (celcius * (9.0/5.0)) + 32 : celcius;
+}
+
+int main() {
+    thermistor_init(THERMISTOR_DEFAULT_BETA);
+
+    // the table has to match the formula before timing it means anything
+    int mismatches = 0;
+    for(int raw = 1; raw < 4095; raw++) {
+        float table;
+        thermistor_convert(&raw, &table, 1, 1);
+        if(fabsf(table - formula_temperature(raw, 1)) > 0.001f) mismatches++;
+    }
+
+    int raw[1024];
+    for(int i = 0; i < 1024; i++) raw[i] = 1000 + rand() % 2000;
+
+    double sum = 0;
+    double begin = now_seconds();
+    for(int i = 0; i < ITERATIONS; i++) {
+        sum += formula_temperature(raw[i & 1023], 1);
+    }
+    double formula_ns = (now_seconds() - begin) * 1e9 / ITERATIONS;
+
+    begin = now_seconds();
+    float out[1024];
+    for(int i = 0; i < ITERATIONS; i += 1024) {
+        thermistor_convert(raw, out, 1024, 1);
+        sum += out[i & 1023];
+    }
+    double table_ns = (now_seconds() - begin) * 1e9 / ITERATIONS;
+
+    printf("{\"bench\":\"convert\",\"formula_ns\":%.2f,\"table_ns\":%.2f,\"speedup\":%.1f,\"mismatches\":%d,\"checksum\":%.0f}\n",
+           formula_ns, table_ns, formula_ns / table_ns, mismatches, sum);
+    return mismatches == 0 ? 0 : 1;
+}
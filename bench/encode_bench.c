@@ -0,0 +1,149 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../format.h"
+#include "../encode.h"
+
+#define SAMPLES 2000000
+
+double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// The formatting path the clients used before format_report.
+int sprintf_report(char* out, time_t when, const float* temperatures, int n) {
+    struct tm *info = localtime( &when );
+    int length = snprintf(out, FORMAT_LINE_MAX, "%02d:%02d:%02d", info->tm_hour, info->tm_min, info->tm_sec);
+    for(int i = 0; i < n; i++) {
+        length += snprintf(out + length, FORMAT_LINE_MAX - length, " %0.1f", temperatures[i]);
+    }
+    out[length++] = '\n';
+    return length;
+}
+
+// A slowly drifting reading with a little noise, like a room thermistor.
+void sample(int i, float* temperatures, int channels) {
+    for(int c = 0; c < channels; c++) {
+        temperatures[c] = 72 + 3 * sinf(i / 500.0f) + (rand() % 5 - 2) / 10.0f + c;
+    }
+}
+
+// Decodes a stream of records and checks every value against what went in.
+// Returns the number of mismatches.
+int validate(const char* stream, int length, int batch, int channels, int64_t start_ms, int period_ms) {
+    static struct decoded_record record;
+    int mismatches = 0;
+    int seen = 0;
+    srand(1);
+    int offset = 0;
+    while(offset < length) {
+        int used = decode_record(stream + offset, length - offset, &record);
+        if(used <= 0) return mismatches + 1;
+        for(int s = 0; s < record.count; s++, seen++) {
+            float temperatures[ENCODE_MAX_CHANNELS];
+            sample(seen, temperatures, channels);
+            if(record.when_ms[s] != start_ms + (int64_t) seen * period_ms) mismatches++;
+            for(int c = 0; c < channels; c++) {
+                if(record.hundredths[s][c] != lrintf(temperatures[c] * 100)) mismatches++;
+            }
+        }
+        if(record.count != batch || record.channels != channels) mismatches++;
+        offset += used;
+    }
+    return mismatches;
+}
+
+// Cuts a stream at arbitrary points, as a reconnect or a spool drop does, and
+// checks the decoder finds the next whole record. Returns the records lost beyond the cut one.
+int resync_losses(const char* stream, int length) {
+    static struct decoded_record record;
+    int losses = 0;
+    for(int cut = 1; cut < 200 && cut < length; cut += 7) {
+        int offset = cut;
+        int decoded = 0;
+        while(offset < length) {
+            int used = decode_record(stream + offset, length - offset, &record);
+            if(used <= 0) {
+                offset++;
+                continue;
+            }
+            decoded++;
+            offset += used;
+        }
+        int expected = 0;
+        for(offset = 0; offset < length; ) {
+            if(offset >= cut) expected++;
+            offset += decode_record(stream + offset, length - offset, &record);
+        }
+        if(decoded < expected) losses += expected - decoded;
+    }
+    return losses;
+}
+
+int main(int argc, char* argv[]) {
+    int batch = argc > 1 ? atoi(argv[1]) : 1;
+    int channels = argc > 2 ? atoi(argv[2]) : 1;
+    if(batch < 1 || batch > ENCODE_MAX_SAMPLES) batch = 1;
+    if(channels < 1 || channels > ENCODE_MAX_CHANNELS) channels = 1;
+
+    int period_ms = 1000;
+    int64_t start_ms = (int64_t) time(0) * 1000;
+    float temperatures[ENCODE_MAX_CHANNELS];
+    char line[FORMAT_LINE_MAX];
+
+    long text_bytes = 0;
+    srand(1);
+    double begin = now_seconds();
+    for(int i = 0; i < SAMPLES; i++) {
+        sample(i, temperatures, channels);
+        text_bytes += sprintf_report(line, (start_ms + (int64_t) i * period_ms) / 1000, temperatures, channels);
+    }
+    double sprintf_ns = (now_seconds() - begin) * 1e9 / SAMPLES;
+
+    srand(1);
+    begin = now_seconds();
+    for(int i = 0; i < SAMPLES; i++) {
+        sample(i, temperatures, channels);
+        format_report(line, (start_ms + (int64_t) i * period_ms) / 1000, temperatures, channels);
+    }
+    double format_ns = (now_seconds() - begin) * 1e9 / SAMPLES;
+
+    int validated = SAMPLES / batch * batch;
+    char* stream = malloc((long) validated * (10 + channels * 5) + (long) validated / batch * 40);
+    long binary_bytes = 0;
+    static struct report_encoder encoder;
+    encoder_init(&encoder, 40205638, channels);
+    srand(1);
+    begin = now_seconds();
+    for(int i = 0; i < validated; i++) {
+        sample(i, temperatures, channels);
+        encoder_add(&encoder, start_ms + (int64_t) i * period_ms, temperatures, 1);
+        if(encoder.count == batch) {
+            binary_bytes += encoder_finish(&encoder, stream + binary_bytes);
+        }
+    }
+    double binary_ns = (now_seconds() - begin) * 1e9 / validated;
+
+    begin = now_seconds();
+    int mismatches = validate(stream, binary_bytes, batch, channels, start_ms, period_ms);
+    double decode_check_ns = (now_seconds() - begin) * 1e9 / validated;
+    // the resync check only needs the first few hundred records
+    static struct decoded_record record;
+    int prefix = 0;
+    while(prefix < binary_bytes && prefix < 100000) {
+        prefix += decode_record(stream + prefix, binary_bytes - prefix, &record);
+    }
+    int lost = resync_losses(stream, prefix);
+    free(stream);
+
+    printf("{\"bench\":\"encode\",\"batch\":%d,\"channels\":%d,\"text_bytes_per_sample\":%.2f,\"binary_bytes_per_sample\":%.2f,"
+           "\"sprintf_ns\":%.1f,\"format_ns\":%.1f,\"binary_ns\":%.1f,\"decode_check_ns\":%.1f,\"mismatches\":%d,\"resync_losses\":%d}\n",
+           batch, channels, (double) text_bytes / SAMPLES, (double) binary_bytes / validated,
+           sprintf_ns, format_ns, binary_ns, decode_check_ns, mismatches, lost);
+    return mismatches == 0 && lost == 0 ? 0 : 1;
+}
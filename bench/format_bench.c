@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../format.h"
+#include "../thermistor.h"
+
+#define ITERATIONS 5000000
+
+double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// The formatting path the clients used before format_report.
+int sprintf_report(char* out, time_t when, const float* temperatures, int n) {
+    struct tm *info = localtime( &when );
+    int length = snprintf(out, FORMAT_LINE_MAX, "%02d:%02d:%02d", info->tm_hour, info->tm_min, info->tm_sec);
+    for(int i = 0; i < n; i++) {
+        length += snprintf(out + length, FORMAT_LINE_MAX - length, " %0.1f", temperatures[i]);
+    }
+    out[length++] = '\n';
+    return length;
+}
+
+int main(int argc, char* argv[]) {
+    int channels = argc > 1 ? atoi(argv[1]) : 1;
+    if(channels < 1 || channels > 8) channels = 1;
+
+    float temperatures[8];
+    time_t start = time(0);
+    thermistor_init(THERMISTOR_DEFAULT_BETA);
+    char expected[FORMAT_LINE_MAX];
+    char actual[FORMAT_LINE_MAX];
+
+    // both paths have to agree before timing them means anything
+    int mismatches = 0;
+    for(int i = 0; i < 100000; i++) {
+        for(int c = 0; c < channels; c++) temperatures[c] = -40 + (rand() % 1700) / 10.0f + c;
+        int a = sprintf_report(expected, start + i, temperatures, channels);
+        int b = format_report(actual, start + i, temperatures, channels);
+        if(a != b || memcmp(expected, actual, a) != 0) mismatches++;
+    }
+
+    // and for every temperature the thermistor tables can produce, in both scales
+    for(int raw = 0; raw < 4096; raw++) {
+        for(int fahrenheit = 0; fahrenheit < 2; fahrenheit++) {
+            thermistor_convert(&raw, temperatures, 1, fahrenheit);
+            int a = sprintf_report(expected, start, temperatures, 1);
+            int b = format_report(actual, start, temperatures, 1);
+            if(a != b || memcmp(expected, actual, a) != 0) mismatches++;
+        }
+    }
+    // exact ties and negative values that round to zero
+    float edges[] = { 72.25f, -3.25f, 0.25f, -0.25f, 0.75f, -0.04f, -0.0f, 0.05f, -273.15f };
+    for(int e = 0; e < (int) (sizeof(edges) / sizeof(edges[0])); e++) {
+        int a = sprintf_report(expected, start, &edges[e], 1);
+        int b = format_report(actual, start, &edges[e], 1);
+        if(a != b || memcmp(expected, actual, a) != 0) mismatches++;
+    }
+
+    long total = 0;
+    double begin = now_seconds();
+    for(int i = 0; i < ITERATIONS; i++) {
+        temperatures[0] = 70 + (i & 63) / 10.0f;
+        total += sprintf_report(actual, start + i / 10, temperatures, channels);
+    }
+    double sprintf_ns = (now_seconds() - begin) * 1e9 / ITERATIONS;
+
+    begin = now_seconds();
+    for(int i = 0; i < ITERATIONS; i++) {
+        temperatures[0] = 70 + (i & 63) / 10.0f;
+        total += format_report(actual, start + i / 10, temperatures, channels);
+    }
+    double format_ns = (now_seconds() - begin) * 1e9 / ITERATIONS;
+
+    printf("{\"bench\":\"format\",\"channels\":%d,\"sprintf_ns\":%.1f,\"format_ns\":%.1f,\"speedup\":%.2f,\"mismatches\":%d,\"bytes\":%ld}\n",
+           channels, sprintf_ns, format_ns, sprintf_ns / format_ns, mismatches, total);
+    return mismatches == 0 ? 0 : 1;
+}
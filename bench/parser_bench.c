@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../parser.h"
+
+#define STREAM_SIZE (8 * 1024 * 1024)
+#define FUZZ_ROUNDS 2000
+
+double now_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// What the parser should produce, worked out the slow way.
+char* expected_lines[STREAM_SIZE];
+int expected_lengths[STREAM_SIZE];
+int expected_count = 0;
+int seen_count = 0;
+int mismatches = 0;
+long commands_found = 0;
+
+void check_line(char* line, int length) {
+    if(seen_count >= expected_count || expected_lengths[seen_count] != length ||
+       memcmp(expected_lines[seen_count], line, length) != 0 || line[length] != '\0') {
+        mismatches++;
+    }
+    seen_count++;
+}
+
+void count_command(char* line, int length) {
+    const char* argument;
+    if(command_lookup(line, length, &argument) != COMMAND_UNKNOWN) commands_found++;
+}
+
+// Random bytes with plenty of newlines, the odd overlong line, fed in random sized reads.
+void fuzz_round(char* stream, char* copy) {
+    int size = 1 + rand() % 4096;
+    for(int i = 0; i < size; i++) {
+        int pick = rand() % 100;
+        stream[i] = pick < 8 ? '\n' : pick < 10 ? 'S' : (char) (rand() % 256);
+    }
+    if(rand() % 4 == 0) {
+        int start = rand() % size;
+        int span = COMMAND_LINE_MAX + rand() % 200;
+        for(int i = start; i < size && i < start + span; i++) stream[i] = 'x';
+    }
+    memcpy(copy, stream, size);
+
+    expected_count = 0;
+    int line_start = 0;
+    for(int i = 0; i < size; i++) {
+        if(copy[i] != '\n') continue;
+        if(i - line_start < COMMAND_LINE_MAX) {
+            expected_lines[expected_count] = copy + line_start;
+            expected_lengths[expected_count++] = i - line_start;
+        }
+        line_start = i + 1;
+    }
+
+    struct line_parser parser;
+    parser_reset(&parser);
+    seen_count = 0;
+    int offset = 0;
+    while(offset < size) {
+        int chunk = 1 + rand() % 300;
+        if(chunk > size - offset) chunk = size - offset;
+        parser_feed(&parser, stream + offset, chunk, check_line);
+        offset += chunk;
+    }
+    if(seen_count != expected_count) mismatches++;
+}
+
+int main() {
+    srand(134);
+    char* stream = malloc(STREAM_SIZE);
+    char* copy = malloc(STREAM_SIZE);
+
+    for(int round = 0; round < FUZZ_ROUNDS; round++) {
+        fuzz_round(stream, copy);
+    }
+
+    // a server pipelining many commands back to back
+    const char* burst[] = { "SCALE=F\n", "PERIOD=0.5\n", "STOP\n", "START\n", "LOG sensor swapped\n", "SCALE=C\n", "BATCH=8\n" };
+    int length = 0;
+    long lines = 0;
+    while(1) {
+        const char* command = burst[lines % 7];
+        int command_length = strlen(command);
+        if(length + command_length > STREAM_SIZE) break;
+        memcpy(copy + length, command, command_length);
+        length += command_length;
+        lines++;
+    }
+
+    struct line_parser parser;
+    parser_reset(&parser);
+    double begin = now_seconds();
+    for(int repeat = 0; repeat < 10; repeat++) {
+        memcpy(stream, copy, length);
+        for(int offset = 0; offset < length; offset += 4096) {
+            int chunk = length - offset < 4096 ? length - offset : 4096;
+            parser_feed(&parser, stream + offset, chunk, count_command);
+        }
+    }
+    double seconds = now_seconds() - begin;
+
+    printf("{\"bench\":\"parser\",\"fuzz_rounds\":%d,\"fuzz_mismatches\":%d,\"commands_per_sec\":%.0f,\"mb_per_sec\":%.1f,\"commands\":%ld}\n",
+           FUZZ_ROUNDS, mismatches, commands_found / seconds, 10.0 * length / seconds / 1e6, commands_found);
+    free(stream);
+    free(copy);
+    return mismatches == 0 && commands_found == 10 * lines ? 0 : 1;
+}
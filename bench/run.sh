@@ -0,0 +1,58 @@
+#!/bin/bash
+# Runs the micro and macro benchmarks and writes one JSON object per line to
+# bench/results.jsonl. Macro runs go through the local collector over tcp,
+# TLS and a Unix socket: latency with one binary-encoded client, throughput
+# with a gateway of BENCH_DEVICES devices sampling every millisecond.
+set -e
+cd "$(dirname "$0")/.."
+
+OUT=bench/results.jsonl
+PORT=${BENCH_PORT:-18700}
+RUN_SECONDS=${BENCH_SECONDS:-3}
+DEVICES=${BENCH_DEVICES:-100}
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+echo "{\"bench\":\"run\",\"commit\":\"$(git rev-parse --short HEAD 2>/dev/null || echo unknown)\",\"date\":\"$(date -u +%FT%TZ)\",\"cpus\":$(nproc)}" > $OUT
+./bench/convert_bench >> $OUT
+./bench/format_bench 1 >> $OUT
+./bench/parser_bench >> $OUT
+./bench/encode_bench 32 >> $OUT
+./bench/tls_bench 32 >> $OUT
+./bench/tls_bench 32 ktls >> $OUT
+
+# macro LABEL TRANSPORT CLIENT...
+macro() {
+    local label=$1 transport=$2
+    shift 2
+    local tls="" host=127.0.0.1
+    if [ "$transport" = tls ]; then tls="--cert=bench/cert.pem --key=bench/key.pem"; fi
+    if [ "$transport" = unix ]; then host=unix:$WORK/collector.sock; fi
+    ./collector $tls --unix=$WORK/collector.sock --seconds=$RUN_SECONDS $COLLECTOR_OPTIONS --label=${label}_$transport $PORT >> $OUT &
+    local collector=$!
+    sleep 0.3
+    "$@" --host=$host --log=$WORK/$label.log $PORT > /dev/null 2>&1 || true
+    wait $collector
+    PORT=$((PORT + 1))
+}
+
+for transport in tcp tls unix; do
+    client=./lab4c_tcp
+    gateway_tls=""
+    if [ "$transport" = tls ]; then client=./lab4c_tls; gateway_tls=--tls; fi
+    macro latency $transport $client --id=400000000 --sensor=sim --period=0.01 --encoding=binary
+    macro throughput $transport ./lab4c_gateway $gateway_tls --id=500000000 --devices=$DEVICES --sensor=sim --period=0.001
+done
+
+# bench/commands.txt sent to a binary client and to a gateway, every report checked against it
+COLLECTOR_OPTIONS="--seconds=4 --script=bench/commands.txt"
+macro commands tcp ./lab4c_tcp --id=400000000 --sensor=sim --period=0.01 --encoding=binary
+macro commands_gateway tcp ./lab4c_gateway --id=500000000 --devices=$DEVICES --sensor=sim --period=0.01
+
+# text and binary clients with and without --compression=deflate, compare bytes_per_sample
+for encoding in text binary; do
+    macro ${encoding} tcp ./lab4c_tcp --id=400000000 --sensor=sim --period=0.01 --encoding=$encoding
+    macro ${encoding}_deflate tcp ./lab4c_tcp --id=400000000 --sensor=sim --period=0.01 --encoding=$encoding --compression=deflate
+done
+
+cat $OUT
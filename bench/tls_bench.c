@@ -0,0 +1,158 @@
+#include <pthread.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "../format.h"
+#include "../transport.h"
+
+/*
+ * Client CPU time per sample over TLS, run from the repo root after make
+ * bench/cert.pem. A server thread on loopback reads and discards; the main
+ * thread sends SAMPLES reports in batches through the TLS transport, then
+ * SAMPLES more from a spool-like file. Only the sending thread's CPU time is
+ * counted, which includes the kernel's encryption when kTLS is on.
+ *
+ *   bench/tls_bench [batch] [ktls]
+ */
+
+#define SAMPLES 200000
+#define FILE_CHUNK 65536
+
+int listen_fd = -1;
+long received = 0;
+
+void* thread_server_action() {
+    SSL_CTX* server_ctx = SSL_CTX_new(TLS_server_method());
+    if(SSL_CTX_use_certificate_chain_file(server_ctx, "bench/cert.pem") != 1
+       || SSL_CTX_use_PrivateKey_file(server_ctx, "bench/key.pem", SSL_FILETYPE_PEM) != 1) {
+        fprintf(stderr, "Failed to load bench/cert.pem and bench/key.pem, run make bench/cert.pem\n");
+        exit(1);
+    }
+    int fd = accept(listen_fd, NULL, NULL);
+    SSL* ssl = SSL_new(server_ctx);
+    SSL_set_fd(ssl, fd);
+    if(SSL_accept(ssl) != 1) {
+        ERR_print_errors_fp(stderr);
+        exit(1);
+    }
+    char buffer[65536];
+    int how_much_read;
+    while((how_much_read = SSL_read(ssl, buffer, sizeof(buffer))) > 0) {
+        received += how_much_read;
+    }
+    SSL_free(ssl);
+    close(fd);
+    SSL_CTX_free(server_ctx);
+    return NULL;
+}
+
+double thread_cpu_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// The core's rules: wait for the socket on WANT_*, and a TLS retry repeats the same length.
+void send_all(struct connection* conn, const char* data, int length) {
+    while(length > 0) {
+        int written = tls_transport.write(conn, data, length);
+        if(written == TRANSPORT_WANT_WRITE || written == TRANSPORT_WANT_READ) {
+            struct pollfd wait = { conn->fd, written == TRANSPORT_WANT_WRITE ? POLLOUT : POLLIN, 0 };
+            poll(&wait, 1, -1);
+            continue;
+        }
+        if(written < 0) exit(1);
+        data += written;
+        length -= written;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int batch = argc > 1 ? atoi(argv[1]) : 32;
+    int ktls = argc > 2 && strcmp(argv[2], "ktls") == 0;
+    if(batch < 1) batch = 1;
+
+    struct sockaddr_in address;
+    socklen_t address_length = sizeof(address);
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) < 0 || listen(listen_fd, 1) < 0) {
+        perror("listen");
+        return 1;
+    }
+    getsockname(listen_fd, (struct sockaddr*) &address, &address_length);
+    pthread_t server;
+    pthread_create(&server, NULL, thread_server_action, NULL);
+
+    if(ktls) tls_transport.parse_option('K', NULL);
+    if(tls_transport.init() != 0) return 1;
+    struct connection conn = { -1, NULL, NULL };
+    const char* greeting = "ID=123456789\n";
+    if(tls_transport.open(&conn, "127.0.0.1", ntohs(address.sin_port), greeting, strlen(greeting)) != 0) return 1;
+    int ktls_active = BIO_get_ktls_send(SSL_get_wbio(conn.state)) ? 1 : 0;
+    long expected = strlen(greeting);
+
+    // every batch is the same bytes, so formatting stays out of the timing
+    float temperatures[1] = { 72.5 };
+    char* lines = malloc(batch * FORMAT_LINE_MAX);
+    int lines_length = 0;
+    for(int i = 0; i < batch; i++) lines_length += format_report(lines + lines_length, time(0), temperatures, 1);
+
+    double started = thread_cpu_ns();
+    for(int sent = 0; sent < SAMPLES; sent += batch) {
+        send_all(&conn, lines, lines_length);
+        expected += lines_length;
+    }
+    double live_ns = (thread_cpu_ns() - started) / ((SAMPLES + batch - 1) / batch * batch);
+
+    // the spool: sendfile where the connection can, otherwise copied through a buffer as the core does
+    char path[] = "/tmp/tls_bench_XXXXXX";
+    int file = mkstemp(path);
+    unlink(path);
+    long file_length = 0;
+    for(int sent = 0; sent < SAMPLES; sent += batch) file_length += write(file, lines, lines_length);
+    char* chunk = malloc(FILE_CHUNK);
+    int used_sendfile = 0;
+    started = thread_cpu_ns();
+    for(off_t offset = 0; offset < file_length; ) {
+        int length = file_length - offset < FILE_CHUNK ? file_length - offset : FILE_CHUNK;
+        int sent = tls_transport.sendfile(&conn, file, offset, length);
+        if(sent == TRANSPORT_UNSUPPORTED) {
+            length = pread(file, chunk, length, offset);
+            send_all(&conn, chunk, length);
+            sent = length;
+        } else if(sent == TRANSPORT_WANT_WRITE || sent == TRANSPORT_WANT_READ) {
+            struct pollfd wait = { conn.fd, POLLOUT, 0 };
+            poll(&wait, 1, -1);
+            continue;
+        } else if(sent < 0) {
+            return 1;
+        } else {
+            used_sendfile = 1;
+        }
+        offset += sent;
+    }
+    double file_ns = (thread_cpu_ns() - started) * lines_length / batch / file_length;
+    expected += file_length;
+
+    // the server's session tickets are never read, so closing outright would reset the connection
+    shutdown(conn.fd, SHUT_WR);
+    pthread_join(server, NULL);
+    tls_transport.close(&conn);
+    printf("{\"bench\":\"tls\",\"batch\":%d,\"ktls_requested\":%d,\"ktls_active\":%d,\"live_cpu_ns_per_sample\":%.1f,"
+           "\"spool_cpu_ns_per_sample\":%.1f,\"spool_sendfile\":%d,\"bytes_lost\":%ld}\n",
+           batch, ktls, ktls_active, live_ns, file_ns, used_sendfile, expected - received);
+    close(file);
+    return expected == received ? 0 : 1;
+}
@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "button.h"
+
+int button_open(int chip, int line) {
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/gpiochip%d", chip);
+    int chip_fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(chip_fd == -1) {
+        fprintf(stderr, "Opening %s failed %s \n", path, strerror(errno));
+        return -1;
+    }
+
+    struct gpioevent_request request;
+    memset(&request, 0, sizeof(request));
+    request.lineoffset = line;
+    request.handleflags = GPIOHANDLE_REQUEST_INPUT;
+    request.eventflags = GPIOEVENT_REQUEST_RISING_EDGE;
+    strncpy(request.consumer_label, "lab4c button", sizeof(request.consumer_label) - 1);
+    int status = ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request);
+    close(chip_fd);
+    if(status == -1) {
+        fprintf(stderr, "Requesting edge events on %s line %d failed %s \n", path, line, strerror(errno));
+        return -1;
+    }
+    fcntl(request.fd, F_SETFL, fcntl(request.fd, F_GETFL) | O_NONBLOCK);
+    return request.fd;
+}
+
+int button_pressed(int fd) {
+    struct gpioevent_data event;
+    int pressed = 0;
+    while(read(fd, &event, sizeof(event)) == sizeof(event)) {
+        if(event.id == GPIOEVENT_EVENT_RISING_EDGE) pressed = 1;
+    }
+    return pressed;
+}
+
+void button_close(int fd) {
+    if(fd != -1) close(fd);
+}
@@ -0,0 +1,17 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+/*
+ * The shutdown button. librobotcontrol keeps a GPIO line's event fd to
+ * itself (rc_gpio_init_event returns 0, not an fd, and rc_gpio_poll blocks
+ * on it), so the line is requested through the kernel's GPIO character
+ * device instead. That gives a non-blocking fd the event loop can poll next
+ * to the socket, and every edge is read off it so a press is seen once.
+ */
+// Returns the event fd for rising edges on the line, or -1.
+int button_open(int chip, int line);
+// Consumes the pending edge events. Returns 1 if one of them was a press.
+int button_pressed(int fd);
+void button_close(int fd);
+
+#endif
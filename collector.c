@@ -0,0 +1,730 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "parser.h"
+#include "encode.h"
+#include "compress.h"
+#include "transport.h"
+
+/*
+ * Local stand-in for the course server. It accepts lab4c clients over tcp,
+ * TLS (--cert and --key) or a Unix socket (--unix), checks the greeting and
+ * every report line or binary record as it arrives, and after --seconds
+ * sends OFF to everyone and prints a one line JSON summary. Binary records
+ * carry ms timestamps, so for those clients it also measures the latency
+ * from the sample's deadline to its arrival.
+ *
+ * --script=FILE sends commands at set times, one "SECONDS COMMAND" per line.
+ * Each client remembers what it was sent, and once --grace seconds have
+ * passed its reports are held to it: nothing but SHUTDOWN between STOP and
+ * START, and for binary clients the new scale after SCALE= and no two
+ * samples closer than half the period after PERIOD=. Timestamps must never
+ * go backwards. A client that greets with COMPRESS_GREETING is inflated
+ * first, and bytes and bytes_per_sample count what came over the wire.
+ *
+ * --workers=N runs N epoll loops on the same listening sockets, EPOLLEXCLUSIVE
+ * waking one of them per connection. A loop owns the clients it accepted,
+ * runs the script for them and keeps its own counts, so nothing is shared
+ * on the report path.
+ */
+
+#define MAX_EVENTS 256
+#define MAX_LATENCIES (1 << 20)
+#define RECORD_BUFFER (2 * ENCODE_RECORD_MAX)
+#define MAX_STEPS 256
+#define MAX_WORKERS 64
+#define MIN_PERIOD 0.001
+// how long clients get to send SHUTDOWN after OFF
+#define DRAIN_SECONDS 2
+
+enum client_state {
+    CLIENT_HANDSHAKE,
+    CLIENT_GREETING,
+    // after ID=, ENCODING=binary and COMPRESSION=deflate lines may follow
+    CLIENT_ENCODING,
+    CLIENT_TEXT,
+    CLIENT_BINARY,
+};
+
+struct client {
+    int fd;
+    SSL* ssl;
+    enum client_state state;
+    int id;
+    struct line_parser lines;
+    int binary;
+    // set once the client greeted with COMPRESS_GREETING
+    struct decompressor* inflater;
+    // greeting bytes, or binary records not yet decoded
+    char* pending;
+    int pending_len;
+    // what the script told this client, each checked from a realtime ms on
+    int64_t stopped_since;
+    int fahrenheit;
+    int64_t scale_since;
+    int64_t min_gap_ms;
+    int64_t period_since;
+    // the latest timestamp, ms for binary and seconds of the day for text
+    int64_t last_time;
+    struct client* prev;
+    struct client* next;
+};
+
+enum count {
+    COUNT_CLIENTS,
+    COUNT_REPORTS,
+    COUNT_SAMPLES,
+    COUNT_INVALID,
+    COUNT_SHUTDOWNS,
+    // samples sent back for HISTORY=
+    COUNT_HISTORY,
+    COUNT_OUT_OF_ORDER,
+    COUNT_WHILE_STOPPED,
+    COUNT_WRONG_SCALE,
+    COUNT_TOO_FAST,
+    COUNT_COMMANDS,
+    COUNT_SEND_FAILURES,
+    COUNT_ACCEPT_FAILURES,
+    // as received, and what compressed clients' bytes inflated to
+    COUNT_BYTES,
+    COUNT_INFLATED_BYTES,
+    COUNTS,
+};
+
+const char* count_names[COUNTS] = {
+    "clients", "reports", "samples", "invalid", "shutdowns", "history", "out_of_order", "while_stopped",
+    "wrong_scale", "too_fast", "commands", "send_failures", "accept_failures", "bytes", "inflated_bytes",
+};
+
+struct worker {
+    pthread_t thread;
+    int epoll_fd;
+    // every client this loop accepted, so commands can go to all of them
+    struct client* clients;
+    long open;
+    int off_sent;
+    long counts[COUNTS];
+    // samples that arrived before OFF went out
+    long samples_in_time;
+    int64_t* latencies;
+    long latency_count;
+};
+
+struct step {
+    double at;
+    char line[COMMAND_LINE_MAX];
+    int length;
+};
+
+struct listener {
+    int fd;
+    int tls;
+};
+
+SSL_CTX* server_ctx = NULL;
+struct listener listeners[2] = { { -1, 0 }, { -1, 0 } };
+struct step steps[MAX_STEPS];
+int step_count = 0;
+double started = 0;
+double run_seconds = 10;
+int64_t grace_ms = 1000;
+atomic_long clients_open;
+atomic_long peak_clients;
+
+__thread struct worker* current_worker = NULL;
+__thread struct client* current_client = NULL;
+// when the data being handled arrived, realtime ms
+__thread int64_t arrived_ms = 0;
+
+int64_t now_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+double monotonic_seconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// " T0 T1 ..." with each T like -12.3.
+int valid_temperatures(const char* p, const char* end) {
+    if(p == end) return 0;
+    while(p < end) {
+        if(*p++ != ' ') return 0;
+        if(p < end && *p == '-') p++;
+        if(p >= end || !is_digit(*p)) return 0;
+        while(p < end && is_digit(*p)) p++;
+        if(end - p < 2 || p[0] != '.' || !is_digit(p[1])) return 0;
+        p += 2;
+    }
+    return 1;
+}
+
+enum line_kind {
+    LINE_INVALID,
+    LINE_REPORT,
+    LINE_SHUTDOWN,
+    LINE_HISTORY,
+};
+
+// "HH:MM:SS T0 T1 ...", "HH:MM:SS SHUTDOWN", or a HISTORY= reply line "HISTORY MS T0 T1 ...".
+enum line_kind valid_report(const char* line, int length) {
+    const char* end = line + length;
+    if(length > 8 && memcmp(line, "HISTORY ", 8) == 0) {
+        const char* p = line + 8;
+        if(p == end || !is_digit(*p)) return LINE_INVALID;
+        while(p < end && is_digit(*p)) p++;
+        return valid_temperatures(p, end) ? LINE_HISTORY : LINE_INVALID;
+    }
+    if(length < 10 || line[2] != ':' || line[5] != ':' || line[8] != ' ') return LINE_INVALID;
+    if(!is_digit(line[0]) || !is_digit(line[1]) || !is_digit(line[3]) || !is_digit(line[4]) || !is_digit(line[6]) || !is_digit(line[7])) return LINE_INVALID;
+    if(length == 17 && memcmp(line + 9, "SHUTDOWN", 8) == 0) return LINE_SHUTDOWN;
+    return valid_temperatures(line + 8, end) ? LINE_REPORT : LINE_INVALID;
+}
+
+int stopped(struct client* c) {
+    return c->stopped_since != 0 && arrived_ms > c->stopped_since;
+}
+
+void on_line(char* line, int length) {
+    struct client* c = current_client;
+    long* counts = current_worker->counts;
+    enum line_kind kind = valid_report(line, length);
+    if(kind == LINE_INVALID) {
+        counts[COUNT_INVALID]++;
+        return;
+    }
+    if(kind == LINE_HISTORY) {
+        counts[COUNT_HISTORY]++;
+        return;
+    }
+    int second = ((line[0] - '0') * 10 + line[1] - '0') * 3600 + ((line[3] - '0') * 10 + line[4] - '0') * 60
+                 + (line[6] - '0') * 10 + line[7] - '0';
+    // going back more than half a day is midnight
+    if(second < c->last_time && c->last_time - second < 43200) counts[COUNT_OUT_OF_ORDER]++;
+    c->last_time = second;
+    if(kind == LINE_SHUTDOWN) {
+        counts[COUNT_SHUTDOWNS]++;
+    } else {
+        if(stopped(c)) counts[COUNT_WHILE_STOPPED]++;
+        counts[COUNT_REPORTS]++;
+        counts[COUNT_SAMPLES]++;
+    }
+}
+
+void on_record(struct client* c, struct decoded_record* record) {
+    struct worker* w = current_worker;
+    if(record->type == RECORD_SHUTDOWN) {
+        w->counts[COUNT_SHUTDOWNS]++;
+        return;
+    }
+    if(record->type == RECORD_HISTORY) {
+        w->counts[COUNT_HISTORY] += record->count;
+        return;
+    }
+    w->counts[COUNT_REPORTS]++;
+    w->counts[COUNT_SAMPLES] += record->count;
+    if(stopped(c)) w->counts[COUNT_WHILE_STOPPED]++;
+    if(c->fahrenheit != -1 && record->fahrenheit != c->fahrenheit && record->when_ms[0] > c->scale_since) {
+        w->counts[COUNT_WRONG_SCALE]++;
+    }
+    for(int s = 0; s < record->count; s++) {
+        int64_t when = record->when_ms[s];
+        if(when < c->last_time) {
+            w->counts[COUNT_OUT_OF_ORDER]++;
+        } else if(c->min_gap_ms > 0 && c->last_time > c->period_since && when - c->last_time < c->min_gap_ms) {
+            w->counts[COUNT_TOO_FAST]++;
+        }
+        c->last_time = when;
+        if(w->latency_count < MAX_LATENCIES) w->latencies[w->latency_count++] = arrived_ms - when;
+    }
+}
+
+void on_records(struct client* c) {
+    static __thread struct decoded_record record;
+    int offset = 0;
+    while(offset < c->pending_len) {
+        int used = decode_record(c->pending + offset, c->pending_len - offset, &record);
+        if(used == 0) break;
+        if(used < 0) {
+            current_worker->counts[COUNT_INVALID]++;
+            offset++;
+            continue;
+        }
+        offset += used;
+        on_record(c, &record);
+    }
+    memmove(c->pending, c->pending + offset, c->pending_len - offset);
+    c->pending_len -= offset;
+}
+
+void client_close(struct client* c) {
+    struct worker* w = current_worker;
+    if(c->prev != NULL) c->prev->next = c->next; else w->clients = c->next;
+    if(c->next != NULL) c->next->prev = c->prev;
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    if(c->ssl != NULL) SSL_free(c->ssl);
+    close(c->fd);
+    if(c->inflater != NULL) {
+        decompressor_end(c->inflater);
+        free(c->inflater);
+    }
+    free(c->pending);
+    free(c);
+    w->open--;
+    atomic_fetch_sub(&clients_open, 1);
+}
+
+void client_send(struct client* c, const char* data, int length) {
+    int sent = c->ssl != NULL ? SSL_write(c->ssl, data, length) : write(c->fd, data, length);
+    current_worker->counts[sent == length ? COUNT_COMMANDS : COUNT_SEND_FAILURES]++;
+}
+
+// Sends a command and notes what the client's reports must show from now on.
+void client_command(struct client* c, const char* line, int length) {
+    client_send(c, line, length);
+    const char* argument = NULL;
+    int64_t since = now_ms() + grace_ms;
+    switch(command_lookup(line, length - 1, &argument)) {
+        case COMMAND_STOP:
+            if(c->stopped_since == 0) c->stopped_since = since;
+            break;
+        case COMMAND_START:
+            c->stopped_since = 0;
+            break;
+        case COMMAND_SCALE_C:
+        case COMMAND_SCALE_F:
+            c->fahrenheit = line[6] == 'F';
+            c->scale_since = since;
+            break;
+        case COMMAND_PERIOD: {
+            double period = atof(argument);
+            if(period >= MIN_PERIOD) {
+                c->min_gap_ms = period * 500;
+                c->period_since = since;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void broadcast(const char* line, int length) {
+    for(struct client* c = current_worker->clients; c != NULL; c = c->next) {
+        if(c->state != CLIENT_HANDSHAKE) client_command(c, line, length);
+    }
+}
+
+// A client that finishes connecting after OFF went out still has to be told.
+void client_ready(struct client* c) {
+    if(current_worker->off_sent) client_command(c, "OFF\n", 4);
+}
+
+// Hands uncompressed report bytes to the line parser or the record decoder.
+void client_reports(struct client* c, char* data, int length) {
+    current_client = c;
+    if(c->state == CLIENT_TEXT) {
+        parser_feed(&c->lines, data, length, on_line);
+        return;
+    }
+    while(length > 0) {
+        int piece = length;
+        if(piece > RECORD_BUFFER - c->pending_len) piece = RECORD_BUFFER - c->pending_len;
+        memcpy(c->pending + c->pending_len, data, piece);
+        c->pending_len += piece;
+        data += piece;
+        length -= piece;
+        on_records(c);
+    }
+}
+
+// Inflates a compressed client's bytes on their way to client_reports.
+// Returns -1 if the stream is corrupt.
+int client_data(struct client* c, char* data, int length) {
+    if(c->inflater == NULL) {
+        client_reports(c, data, length);
+        return 0;
+    }
+    char plain[16384];
+    int produced;
+    do {
+        int used;
+        produced = decompressor_read(c->inflater, data, length, &used, plain, sizeof(plain));
+        if(produced < 0) return -1;
+        current_worker->counts[COUNT_INFLATED_BYTES] += produced;
+        client_reports(c, plain, produced);
+        data += used;
+        length -= used;
+    } while(length > 0 || produced == (int) sizeof(plain));
+    return 0;
+}
+
+// The greeting is over, the rest is reports, binary if the client said so.
+void greeted(struct client* c) {
+    c->state = c->binary ? CLIENT_BINARY : CLIENT_TEXT;
+    c->pending_len = 0;
+    if(c->binary) c->pending = realloc(c->pending, RECORD_BUFFER);
+}
+
+// "ID=" and a positive number that fits the client's int, then the newline.
+int valid_id_line(const char* line, int length) {
+    if(length < 5 || memcmp(line, "ID=", 3) != 0 || line[3] < '0' || line[3] > '9') return 0;
+    char* end;
+    long value = strtol(line + 3, &end, 10);
+    return end == line + length - 1 && value > 0 && value <= INT_MAX;
+}
+
+// Moves greeting bytes along. Returns how much of data it used.
+int greet(struct client* c, char* data, int length) {
+    int used = 0;
+    while(used < length && (c->state == CLIENT_GREETING || c->state == CLIENT_ENCODING)) {
+        if(c->pending_len < COMMAND_LINE_MAX) c->pending[c->pending_len++] = data[used];
+        used++;
+        char* newline = memchr(c->pending, '\n', c->pending_len);
+        if(c->state == CLIENT_GREETING) {
+            if(newline == NULL) continue;
+            if(!valid_id_line(c->pending, c->pending_len)) current_worker->counts[COUNT_INVALID]++;
+            c->id = atoi(c->pending + 3);
+            c->pending_len = 0;
+            c->state = CLIENT_ENCODING;
+        } else {
+            int encoding = !c->binary && memcmp(c->pending, ENCODE_GREETING, c->pending_len) == 0;
+            int compression = memcmp(c->pending, COMPRESS_GREETING, c->pending_len) == 0;
+            if(!encoding && !compression) {
+                // not a greeting line, these bytes were the first report
+                char first[COMMAND_LINE_MAX];
+                int first_len = c->pending_len;
+                memcpy(first, c->pending, first_len);
+                greeted(c);
+                client_reports(c, first, first_len);
+            } else if(encoding && c->pending_len == (int) strlen(ENCODE_GREETING)) {
+                c->binary = 1;
+                c->pending_len = 0;
+            } else if(compression && c->pending_len == (int) strlen(COMPRESS_GREETING)) {
+                // compression comes last, everything after it is deflated
+                c->inflater = malloc(sizeof(struct decompressor));
+                if(decompressor_init(c->inflater) != 0) {
+                    free(c->inflater);
+                    c->inflater = NULL;
+                    current_worker->counts[COUNT_INVALID]++;
+                }
+                greeted(c);
+            }
+        }
+    }
+    return used;
+}
+
+void client_readable(struct client* c) {
+    if(c->state == CLIENT_HANDSHAKE) {
+        int status = SSL_accept(c->ssl);
+        if(status != 1) {
+            int error = SSL_get_error(c->ssl, status);
+            if(error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE) client_close(c);
+            return;
+        }
+        c->state = CLIENT_GREETING;
+        client_ready(c);
+    }
+
+    char buffer[16384];
+    while(1) {
+        int how_much_read;
+        if(c->ssl != NULL) {
+            how_much_read = SSL_read(c->ssl, buffer, sizeof(buffer));
+            if(how_much_read <= 0) {
+                int error = SSL_get_error(c->ssl, how_much_read);
+                if(error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE) return;
+                client_close(c);
+                return;
+            }
+        } else {
+            how_much_read = read(c->fd, buffer, sizeof(buffer));
+            if(how_much_read < 0 && errno == EAGAIN) return;
+            if(how_much_read <= 0) {
+                client_close(c);
+                return;
+            }
+        }
+
+        arrived_ms = now_ms();
+        current_worker->counts[COUNT_BYTES] += how_much_read;
+        int used = greet(c, buffer, how_much_read);
+        if((c->state == CLIENT_TEXT || c->state == CLIENT_BINARY) && client_data(c, buffer + used, how_much_read - used) != 0) {
+            current_worker->counts[COUNT_INVALID]++;
+            client_close(c);
+            return;
+        }
+    }
+}
+
+void client_accept(struct listener* listener) {
+    struct worker* w = current_worker;
+    while(1) {
+        int fd = accept(listener->fd, NULL, NULL);
+        if(fd < 0) {
+            if(errno != EAGAIN) w->counts[COUNT_ACCEPT_FAILURES]++;
+            return;
+        }
+        set_nonblocking(fd);
+        struct client* c = calloc(1, sizeof(struct client));
+        c->fd = fd;
+        c->state = CLIENT_GREETING;
+        c->pending = malloc(COMMAND_LINE_MAX);
+        c->fahrenheit = -1;
+        c->last_time = -1;
+        parser_reset(&c->lines);
+        if(listener->tls) {
+            c->ssl = SSL_new(server_ctx);
+            SSL_set_fd(c->ssl, fd);
+            c->state = CLIENT_HANDSHAKE;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = c;
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        c->next = w->clients;
+        if(w->clients != NULL) w->clients->prev = c;
+        w->clients = c;
+        w->counts[COUNT_CLIENTS]++;
+        w->open++;
+        long open = atomic_fetch_add(&clients_open, 1) + 1;
+        long peak = atomic_load(&peak_clients);
+        while(open > peak && !atomic_compare_exchange_weak(&peak_clients, &peak, open));
+        if(c->state == CLIENT_GREETING) client_ready(c);
+    }
+}
+
+void listen_on(struct listener* listener, struct sockaddr* address, socklen_t length) {
+    int fd = socket(address->sa_family, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    int v6_only = 0;
+    if(address->sa_family == AF_INET6) setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6_only, sizeof(v6_only));
+    if(bind(fd, address, length) < 0 || listen(fd, 4096) < 0) {
+        fprintf(stderr, "Failed to listen %s \n", strerror(errno));
+        exit(1);
+    }
+    set_nonblocking(fd);
+    listener->fd = fd;
+}
+
+void load_script(const char* path) {
+    FILE* file = fopen(path, "r");
+    if(file == NULL) {
+        fprintf(stderr, "Opening the script %s failed %s \n", path, strerror(errno));
+        exit(1);
+    }
+    char line[COMMAND_LINE_MAX];
+    while(fgets(line, sizeof(line), file) != NULL) {
+        double at;
+        int skip = 0;
+        if(line[0] == '#' || sscanf(line, "%lf %n", &at, &skip) != 1 || line[skip] == '\0') continue;
+        if(step_count == MAX_STEPS || (step_count > 0 && at < steps[step_count - 1].at)) {
+            fprintf(stderr, "The script has more than %d steps or is out of order \n", MAX_STEPS);
+            exit(1);
+        }
+        struct step* step = &steps[step_count++];
+        step->at = at;
+        step->length = snprintf(step->line, sizeof(step->line), "%s", line + skip);
+        if(step->line[step->length - 1] != '\n') step->line[step->length++] = '\n';
+    }
+    fclose(file);
+}
+
+/*
+ * One event loop. It sends the script's commands as their time comes, OFF
+ * at the end of the run, then serves until its clients have all gone or
+ * DRAIN_SECONDS pass.
+ */
+void* thread_worker_action(void* argument) {
+    struct worker* w = argument;
+    current_worker = w;
+    struct epoll_event events[MAX_EVENTS];
+    int next_step = 0;
+    double off_at = started + run_seconds;
+    while(1) {
+        double now = monotonic_seconds();
+        while(next_step < step_count && started + steps[next_step].at <= now) {
+            broadcast(steps[next_step].line, steps[next_step].length);
+            next_step++;
+        }
+        if(now >= off_at && !w->off_sent) {
+            w->samples_in_time = w->counts[COUNT_SAMPLES];
+            w->off_sent = 1;
+            broadcast("OFF\n", 4);
+        }
+        if(w->off_sent && (w->open == 0 || now >= off_at + DRAIN_SECONDS)) break;
+
+        double next = w->off_sent ? off_at + DRAIN_SECONDS : off_at;
+        if(next_step < step_count && started + steps[next_step].at < next) next = started + steps[next_step].at;
+        int timeout = (next - now) * 1000 + 1;
+        int ready = epoll_wait(w->epoll_fd, events, MAX_EVENTS, timeout < 50 ? timeout : 50);
+        for(int i = 0; i < ready; i++) {
+            void* ptr = events[i].data.ptr;
+            if(ptr == &listeners[0] || ptr == &listeners[1]) {
+                client_accept(ptr);
+            } else {
+                client_readable(ptr);
+            }
+        }
+    }
+    return NULL;
+}
+
+int compare_latency(const void* a, const void* b) {
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+int64_t latency_percentile(const int64_t* latencies, long count, double fraction) {
+    if(count == 0) return -1;
+    return latencies[(long) (fraction * (count - 1))];
+}
+
+#define USAGE "Use the options [--cert=FILE --key=FILE --unix=PATH --seconds=N --script=FILE --grace=SECONDS --workers=N --label=NAME] PORT\n"
+
+int main(int argc, char *argv[]) {
+    const struct option options[] = {
+        { "cert", required_argument, NULL, 'c'},
+        { "key", required_argument, NULL, 'k'},
+        { "unix", required_argument, NULL, 'u'},
+        { "seconds", required_argument, NULL, 's'},
+        { "script", required_argument, NULL, 'S'},
+        { "grace", required_argument, NULL, 'g'},
+        { "workers", required_argument, NULL, 'w'},
+        { "label", required_argument, NULL, 'l'},
+        { 0, 0, 0, 0}
+    };
+    char* cert = NULL;
+    char* key = NULL;
+    char* unix_path = NULL;
+    char* label = "collector";
+    int worker_count = 1;
+    int curr_option;
+    while((curr_option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch(curr_option) {
+            case 'c': cert = optarg; break;
+            case 'k': key = optarg; break;
+            case 'u': unix_path = optarg; break;
+            case 's': run_seconds = atof(optarg); break;
+            case 'S': load_script(optarg); break;
+            case 'g': grace_ms = atof(optarg) * 1000; break;
+            case 'w': worker_count = atoi(optarg); break;
+            case 'l': label = optarg; break;
+            default:
+                fprintf(stderr, USAGE);
+                exit(1);
+        }
+    }
+    if(optind != argc - 1 || (cert == NULL) != (key == NULL) || worker_count < 1 || worker_count > MAX_WORKERS) {
+        fprintf(stderr, USAGE);
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    raise_fd_limit(1 << 20);
+
+    if(cert != NULL) {
+        server_ctx = SSL_CTX_new(TLS_server_method());
+        if(server_ctx == NULL
+           || SSL_CTX_use_certificate_chain_file(server_ctx, cert) != 1
+           || SSL_CTX_use_PrivateKey_file(server_ctx, key, SSL_FILETYPE_PEM) != 1) {
+            fprintf(stderr, "Failed to load the certificate and key\n");
+            ERR_print_errors_fp(stderr);
+            exit(1);
+        }
+    }
+
+    // IPv6 and IPv4 on one socket
+    struct sockaddr_in6 address;
+    memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(atoi(argv[optind]));
+    listen_on(&listeners[0], (struct sockaddr*) &address, sizeof(address));
+    // the Unix socket is only for local benchmarking and stays plain
+    listeners[0].tls = server_ctx != NULL;
+    if(unix_path != NULL) {
+        struct sockaddr_un local;
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        strncpy(local.sun_path, unix_path, sizeof(local.sun_path) - 1);
+        unlink(unix_path);
+        listen_on(&listeners[1], (struct sockaddr*) &local, sizeof(local));
+    }
+
+    struct worker workers[MAX_WORKERS];
+    memset(workers, 0, sizeof(workers));
+    started = monotonic_seconds();
+    for(int i = 0; i < worker_count; i++) {
+        struct worker* w = &workers[i];
+        w->epoll_fd = epoll_create1(0);
+        w->latencies = malloc(MAX_LATENCIES * sizeof(int64_t));
+        for(int l = 0; l < 2; l++) {
+            if(listeners[l].fd == -1) continue;
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLEXCLUSIVE;
+            event.data.ptr = &listeners[l];
+            epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, listeners[l].fd, &event);
+        }
+        if(pthread_create(&w->thread, NULL, thread_worker_action, w) != 0) {
+            fprintf(stderr, "Failed to start worker %d \n", i);
+            exit(1);
+        }
+    }
+
+    long totals[COUNTS] = { 0 };
+    long in_time = 0;
+    long latency_count = 0;
+    for(int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+        for(int c = 0; c < COUNTS; c++) totals[c] += workers[i].counts[c];
+        in_time += workers[i].samples_in_time;
+        latency_count += workers[i].latency_count;
+    }
+    int64_t* latencies = malloc((latency_count + 1) * sizeof(int64_t));
+    long merged = 0;
+    for(int i = 0; i < worker_count; i++) {
+        memcpy(latencies + merged, workers[i].latencies, workers[i].latency_count * sizeof(int64_t));
+        merged += workers[i].latency_count;
+    }
+    qsort(latencies, latency_count, sizeof(int64_t), compare_latency);
+
+    printf("{\"bench\":\"%s\",\"seconds\":%.2f,\"workers\":%d,\"peak_clients\":%ld,\"samples_per_sec\":%.0f,\"bytes_per_sample\":%.2f",
+           label, run_seconds, worker_count, atomic_load(&peak_clients), in_time / run_seconds,
+           totals[COUNT_SAMPLES] > 0 ? (double) totals[COUNT_BYTES] / totals[COUNT_SAMPLES] : 0.0);
+    for(int c = 0; c < COUNTS; c++) printf(",\"%s\":%ld", count_names[c], totals[c]);
+    printf(",\"latency_ms_p50\":%ld,\"latency_ms_p99\":%ld,\"latency_ms_max\":%ld}\n",
+           latency_percentile(latencies, latency_count, 0.5), latency_percentile(latencies, latency_count, 0.99),
+           latency_percentile(latencies, latency_count, 1.0));
+
+    long failures = totals[COUNT_INVALID] + totals[COUNT_OUT_OF_ORDER] + totals[COUNT_WHILE_STOPPED]
+                    + totals[COUNT_WRONG_SCALE] + totals[COUNT_TOO_FAST];
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "compress.h"
+
+#define WINDOW_BITS 15
+#define MEMORY_LEVEL 8
+
+// What the stream is made of, the likeliest last since deflate prefers the closest match.
+const char compress_dictionary[] =
+    "HISTORY 1700000000000 -10.5 0.0 SHUTDOWN\n"
+    "23:59:59 98.6 99.7 100.8 101.9\n"
+    "12:30:45 18.0 19.1 20.2 21.3 22.4 23.5 24.6 25.7 26.8 27.9\n"
+    "10:00:00 60.0 61.1 62.2 63.3 64.4 65.5 66.6 67.7 68.8 69.9\n"
+    "11:11:11 70.0 71.1 72.2 73.3 74.4 75.5 76.6 77.7 78.8 79.9\n"
+    "12:00:00 72.4\n12:00:01 72.4\n12:00:02 72.5\n12:00:03 72.5\n";
+
+int compressor_init(struct compressor* compressor) {
+    memset(&compressor->stream, 0, sizeof(compressor->stream));
+    // negative window bits make it raw deflate, no header or checksum
+    if(deflateInit2(&compressor->stream, COMPRESS_LEVEL, Z_DEFLATED, -WINDOW_BITS, MEMORY_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "Failed to start the compressor \n");
+        return -1;
+    }
+    deflateSetDictionary(&compressor->stream, (const Bytef*) compress_dictionary, sizeof(compress_dictionary) - 1);
+    return 0;
+}
+
+void compressor_reset(struct compressor* compressor) {
+    deflateReset(&compressor->stream);
+    deflateSetDictionary(&compressor->stream, (const Bytef*) compress_dictionary, sizeof(compress_dictionary) - 1);
+}
+
+int compressor_write(struct compressor* compressor, const char* in, int length, int* used, char* out, int space, int flush) {
+    z_stream* stream = &compressor->stream;
+    stream->next_in = (Bytef*) in;
+    stream->avail_in = length;
+    stream->next_out = (Bytef*) out;
+    stream->avail_out = space;
+    // Z_BUF_ERROR only means there was nothing to do
+    deflate(stream, flush ? Z_PARTIAL_FLUSH : Z_NO_FLUSH);
+    *used = length - stream->avail_in;
+    return space - stream->avail_out;
+}
+
+int decompressor_init(struct decompressor* decompressor) {
+    memset(&decompressor->stream, 0, sizeof(decompressor->stream));
+    if(inflateInit2(&decompressor->stream, -WINDOW_BITS) != Z_OK) return -1;
+    inflateSetDictionary(&decompressor->stream, (const Bytef*) compress_dictionary, sizeof(compress_dictionary) - 1);
+    return 0;
+}
+
+int decompressor_read(struct decompressor* decompressor, const char* in, int length, int* used, char* out, int space) {
+    z_stream* stream = &decompressor->stream;
+    stream->next_in = (Bytef*) in;
+    stream->avail_in = length;
+    stream->next_out = (Bytef*) out;
+    stream->avail_out = space;
+    int status = inflate(stream, Z_SYNC_FLUSH);
+    *used = length - stream->avail_in;
+    // a sender never ends the stream, so Z_STREAM_END is as bad as garbage
+    if(status != Z_OK && status != Z_BUF_ERROR) return -1;
+    return space - stream->avail_out;
+}
+
+void decompressor_end(struct decompressor* decompressor) {
+    inflateEnd(&decompressor->stream);
+}
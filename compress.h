@@ -0,0 +1,44 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <zlib.h>
+
+// Sent last in the greeting to compress everything the client sends after it.
+#define COMPRESS_GREETING "COMPRESSION=deflate\n"
+
+/*
+ * Compressed uplink. A client that greets with COMPRESS_GREETING sends the
+ * rest of the connection, text lines or binary records alike, as one raw
+ * deflate stream (RFC 1951) that both ends prime with compress_dictionary,
+ * so even the first reports after a connect find matches. Commands from the
+ * server stay uncompressed. Every connection starts a fresh stream.
+ *
+ * The sender decides when to flush. A flush is a partial flush, ten bits of
+ * overhead, after which the receiver can decode everything sent so far.
+ */
+#define COMPRESS_LEVEL 6
+
+struct compressor {
+    z_stream stream;
+};
+
+int compressor_init(struct compressor* compressor);
+// Starts a fresh stream for a new connection.
+void compressor_reset(struct compressor* compressor);
+// Compresses what fits of in into out and sets *used to the bytes taken.
+// With flush, everything taken so far is made decodable, done once it
+// returns with all of in used and room left in out. Returns the bytes written.
+int compressor_write(struct compressor* compressor, const char* in, int length, int* used, char* out, int space, int flush);
+
+struct decompressor {
+    z_stream stream;
+};
+
+int decompressor_init(struct decompressor* decompressor);
+// Decompresses what fits of in into out and sets *used to the bytes taken.
+// Returns the bytes written, or -1 if the stream is corrupt. Call again
+// while it fills out.
+int decompressor_read(struct decompressor* decompressor, const char* in, int length, int* used, char* out, int space);
+void decompressor_end(struct decompressor* decompressor);
+
+#endif
@@ -0,0 +1,172 @@
+#include <math.h>
+#include <string.h>
+
+#include "encode.h"
+
+static inline int put_varint(unsigned char* out, uint64_t value) {
+    int length = 0;
+    while(value >= 0x80) {
+        out[length++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    out[length++] = value;
+    return length;
+}
+
+// Returns the bytes used, 0 if the varint runs past end, -1 if it is too long.
+static inline int get_varint(const unsigned char* in, const unsigned char* end, uint64_t* value) {
+    *value = 0;
+    for(int i = 0; i < 10; i++) {
+        if(in + i >= end) return 0;
+        *value |= (uint64_t) (in[i] & 0x7f) << (7 * i);
+        if((in[i] & 0x80) == 0) return i + 1;
+    }
+    return -1;
+}
+
+static inline uint64_t zigzag(int64_t value) {
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+void encoder_init(struct report_encoder* encoder, int id, int channels) {
+    encoder->type = RECORD_REPORTS;
+    encoder->id = id;
+    encoder->channels = channels;
+    encoder->fahrenheit = 1;
+    encoder->count = 0;
+    encoder->length = 0;
+}
+
+int encoder_add(struct report_encoder* encoder, int64_t when_ms, const float* temperatures, int fahrenheit) {
+    if(encoder->count >= ENCODE_MAX_SAMPLES) return -1;
+    if(encoder->count > 0 && fahrenheit != encoder->fahrenheit) return -1;
+
+    unsigned char* out = encoder->samples + encoder->length;
+    if(encoder->count == 0) {
+        encoder->first_ms = when_ms;
+        encoder->fahrenheit = fahrenheit;
+    } else {
+        out += put_varint(out, when_ms > encoder->last_ms ? when_ms - encoder->last_ms : 0);
+    }
+    for(int c = 0; c < encoder->channels; c++) {
+        int32_t value = lrintf(temperatures[c] * 100);
+        out += put_varint(out, zigzag(encoder->count == 0 ? value : (int64_t) value - encoder->last[c]));
+        encoder->last[c] = value;
+    }
+    encoder->last_ms = when_ms;
+    encoder->length = out - encoder->samples;
+    encoder->count++;
+    return 0;
+}
+
+static int finish_record(char* out, enum record_type type, const unsigned char* header, int header_length,
+                         const unsigned char* samples, int samples_length) {
+    unsigned char* record = (unsigned char*) out;
+    int length = 0;
+    record[length++] = ENCODE_MAGIC;
+    record[length++] = type;
+    length += put_varint(record + length, header_length + samples_length);
+    memcpy(record + length, header, header_length);
+    length += header_length;
+    memcpy(record + length, samples, samples_length);
+    length += samples_length;
+
+    unsigned char sum = 0;
+    for(int i = 0; i < header_length; i++) sum += header[i];
+    for(int i = 0; i < samples_length; i++) sum += samples[i];
+    record[length++] = sum;
+    return length;
+}
+
+int encoder_finish(struct report_encoder* encoder, char* out) {
+    if(encoder->count == 0) return 0;
+    unsigned char header[40];
+    int length = put_varint(header, encoder->id);
+    header[length++] = encoder->fahrenheit ? 'F' : 'C';
+    length += put_varint(header + length, encoder->channels);
+    length += put_varint(header + length, encoder->count);
+    length += put_varint(header + length, encoder->first_ms);
+
+    int total = finish_record(out, encoder->type, header, length, encoder->samples, encoder->length);
+    encoder->count = 0;
+    encoder->length = 0;
+    return total;
+}
+
+int encode_shutdown(char* out, int id, int64_t when_ms) {
+    unsigned char header[20];
+    int length = put_varint(header, id);
+    length += put_varint(header + length, when_ms);
+    return finish_record(out, RECORD_SHUTDOWN, header, length, NULL, 0);
+}
+
+int decode_record(const char* data, int length, struct decoded_record* record) {
+    const unsigned char* in = (const unsigned char*) data;
+    const unsigned char* end = in + length;
+    if(length < 1) return 0;
+    if(in[0] != ENCODE_MAGIC) return -1;
+    if(length < 2) return 0;
+    if(in[1] != RECORD_REPORTS && in[1] != RECORD_SHUTDOWN && in[1] != RECORD_HISTORY) return -1;
+
+    uint64_t body_length;
+    int used = get_varint(in + 2, end, &body_length);
+    if(used == 0) return 0;
+    if(used < 0 || body_length > ENCODE_RECORD_MAX) return -1;
+    const unsigned char* body = in + 2 + used;
+    const unsigned char* body_end = body + body_length;
+    if(body_end + 1 > end) return 0;
+
+    unsigned char sum = 0;
+    for(const unsigned char* p = body; p < body_end; p++) sum += *p;
+    if(sum != *body_end) return -1;
+
+    // inside a complete body, running short is as bad as a bad checksum
+    uint64_t value;
+    const unsigned char* p = body;
+#define NEXT_VARINT() \
+    do { \
+        int next = get_varint(p, body_end, &value); \
+        if(next <= 0) return -1; \
+        p += next; \
+    } while(0)
+
+    record->type = in[1];
+    NEXT_VARINT();
+    record->id = value;
+    record->count = 0;
+    if(record->type == RECORD_SHUTDOWN) {
+        NEXT_VARINT();
+        record->when_ms[0] = value;
+        return body_end + 1 - in;
+    }
+
+    if(p >= body_end || (*p != 'F' && *p != 'C')) return -1;
+    record->fahrenheit = *p++ == 'F';
+    NEXT_VARINT();
+    record->channels = value;
+    NEXT_VARINT();
+    record->count = value;
+    if(record->channels < 1 || record->channels > ENCODE_MAX_CHANNELS || value > ENCODE_MAX_SAMPLES) return -1;
+    NEXT_VARINT();
+    int64_t when = value;
+
+    for(int s = 0; s < record->count; s++) {
+        if(s > 0) {
+            NEXT_VARINT();
+            when += value;
+        }
+        record->when_ms[s] = when;
+        for(int c = 0; c < record->channels; c++) {
+            NEXT_VARINT();
+            int64_t delta = unzigzag(value);
+            record->hundredths[s][c] = s == 0 ? delta : record->hundredths[s - 1][c] + delta;
+        }
+    }
+#undef NEXT_VARINT
+    if(p != body_end) return -1;
+    return body_end + 1 - in;
+}
@@ -0,0 +1,75 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stdint.h>
+
+#define ENCODE_MAX_SAMPLES 256
+#define ENCODE_MAX_CHANNELS 8
+// worst case: a header plus every varint at its longest
+#define ENCODE_RECORD_MAX (40 + ENCODE_MAX_SAMPLES * (10 + ENCODE_MAX_CHANNELS * 5))
+
+// Sent after ID= to switch the reports on this connection to binary records.
+#define ENCODE_GREETING "ENCODING=binary\n"
+
+/*
+ * Binary reports. A client that greets with ENCODE_GREETING sends records
+ * instead of text lines (commands from the server stay text):
+ *
+ *   ENCODE_MAGIC, type, body length (varint), body, checksum (sum of body bytes)
+ *
+ * A REPORTS body is the device ID (varint), the scale ('F' or 'C'), the
+ * channel count, the sample count and the first timestamp in ms since the
+ * epoch. Then come the samples. Temperatures are hundredths of a degree,
+ * zigzag varints. The first sample is absolute and each later sample is a
+ * delta to the one before it, with a varint ms delta in front.
+ * A SHUTDOWN body is the device ID and the time in ms. A HISTORY record is
+ * laid out like REPORTS and answers a HISTORY= command.
+ *
+ * A stream can resume mid-record after a reconnect or when the spool drops
+ * old data. The decoder then skips ahead to the next magic byte whose
+ * checksum holds.
+ */
+#define ENCODE_MAGIC 0xB1
+
+enum record_type {
+    RECORD_REPORTS = 1,
+    RECORD_SHUTDOWN = 2,
+    RECORD_HISTORY = 3,
+};
+
+struct report_encoder {
+    enum record_type type;
+    int id;
+    int channels;
+    int fahrenheit;
+    int count;
+    int64_t first_ms;
+    int64_t last_ms;
+    int32_t last[ENCODE_MAX_CHANNELS];
+    int length;
+    unsigned char samples[ENCODE_RECORD_MAX];
+};
+
+// Starts a REPORTS encoder, set type for HISTORY records.
+void encoder_init(struct report_encoder* encoder, int id, int channels);
+// Returns -1 if the record has to be finished first: it is full, or the scale changed.
+int encoder_add(struct report_encoder* encoder, int64_t when_ms, const float* temperatures, int fahrenheit);
+// Writes the pending samples as one record and starts a new one. Returns the length, 0 if empty.
+int encoder_finish(struct report_encoder* encoder, char* out);
+int encode_shutdown(char* out, int id, int64_t when_ms);
+
+struct decoded_record {
+    enum record_type type;
+    int id;
+    int fahrenheit;
+    int channels;
+    int count;
+    int64_t when_ms[ENCODE_MAX_SAMPLES];
+    int32_t hundredths[ENCODE_MAX_SAMPLES][ENCODE_MAX_CHANNELS];
+};
+
+// Returns the bytes used by the record at the start of data, 0 if it is not
+// complete yet, or -1 if data does not start with a valid record (skip a byte).
+int decode_record(const char* data, int length, struct decoded_record* record);
+
+#endif
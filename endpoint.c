@@ -0,0 +1,285 @@
+#include <pthread.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "endpoint.h"
+
+#define MAX_ADDRESSES 8
+#define HOST_MAX 256
+
+struct address {
+    struct sockaddr_storage storage;
+    socklen_t length;
+};
+
+// One server per process, so one entry. Everything is under endpoint_lock.
+pthread_mutex_t endpoint_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t endpoint_resolved = PTHREAD_COND_INITIALIZER;
+char endpoint_host[HOST_MAX] = "";
+int endpoint_port = -1;
+struct address resolved[MAX_ADDRESSES];
+int resolved_count = 0;
+long resolved_at_ms = 0;
+int resolving = 0;
+struct address last_good;
+const char* cache_path = NULL;
+
+long endpoint_ms(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+int same_address(const struct address* a, const struct address* b) {
+    return a->length == b->length && memcmp(&a->storage, &b->storage, a->length) == 0;
+}
+
+// The cache file is one line, "host port address".
+void load_cache() {
+    FILE* file = cache_path != NULL ? fopen(cache_path, "r") : NULL;
+    if(file == NULL) return;
+    char host[HOST_MAX];
+    char numeric[INET6_ADDRSTRLEN];
+    int port;
+    if(fscanf(file, "%255s %d %45s", host, &port, numeric) == 3 && port == endpoint_port && strcmp(host, endpoint_host) == 0) {
+        struct sockaddr_in* v4 = (struct sockaddr_in*) &last_good.storage;
+        struct sockaddr_in6* v6 = (struct sockaddr_in6*) &last_good.storage;
+        memset(&last_good, 0, sizeof(last_good));
+        if(inet_pton(AF_INET, numeric, &v4->sin_addr) == 1) {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(port);
+            last_good.length = sizeof(*v4);
+        } else if(inet_pton(AF_INET6, numeric, &v6->sin6_addr) == 1) {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(port);
+            last_good.length = sizeof(*v6);
+        }
+    }
+    fclose(file);
+}
+
+// Written to a temporary file and renamed, so a crash never leaves half a line.
+void save_cache() {
+    if(cache_path == NULL) return;
+    char numeric[INET6_ADDRSTRLEN];
+    if(getnameinfo((struct sockaddr*) &last_good.storage, last_good.length, numeric, sizeof(numeric), NULL, 0, NI_NUMERICHOST) != 0) return;
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", cache_path);
+    FILE* file = fopen(temporary, "w");
+    if(file == NULL) {
+        fprintf(stderr, "Writing the address cache %s failed %s \n", temporary, strerror(errno));
+        return;
+    }
+    fprintf(file, "%s %d %s\n", endpoint_host, endpoint_port, numeric);
+    if(fclose(file) != 0 || rename(temporary, cache_path) != 0) {
+        fprintf(stderr, "Writing the address cache %s failed %s \n", cache_path, strerror(errno));
+    }
+}
+
+void endpoint_set_cache(const char* path) {
+    pthread_mutex_lock(&endpoint_lock);
+    cache_path = path;
+    pthread_mutex_unlock(&endpoint_lock);
+}
+
+void* thread_resolve_action(void* argument) {
+    (void) argument;
+    pthread_mutex_lock(&endpoint_lock);
+    char host[HOST_MAX];
+    char port[16];
+    strcpy(host, endpoint_host);
+    snprintf(port, sizeof(port), "%d", endpoint_port);
+    pthread_mutex_unlock(&endpoint_lock);
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+    struct addrinfo* results = NULL;
+    int status = getaddrinfo(host, port, &hints, &results);
+
+    pthread_mutex_lock(&endpoint_lock);
+    // the host may have changed while this one was being looked up
+    if(status == 0 && strcmp(host, endpoint_host) == 0) {
+        resolved_count = 0;
+        for(struct addrinfo* result = results; result != NULL && resolved_count < MAX_ADDRESSES; result = result->ai_next) {
+            memcpy(&resolved[resolved_count].storage, result->ai_addr, result->ai_addrlen);
+            resolved[resolved_count].length = result->ai_addrlen;
+            resolved_count++;
+        }
+        resolved_at_ms = endpoint_ms(CLOCK_MONOTONIC);
+    } else if(status != 0) {
+        fprintf(stderr, "Resolving %s failed %s \n", host, gai_strerror(status));
+    }
+    resolving = 0;
+    pthread_cond_broadcast(&endpoint_resolved);
+    pthread_mutex_unlock(&endpoint_lock);
+    if(results != NULL) freeaddrinfo(results);
+    return NULL;
+}
+
+// Points the cache at host and starts a lookup if the addresses are missing
+// or stale. Caller holds endpoint_lock.
+void start_resolving(const char* host, int port) {
+    if(port != endpoint_port || strcmp(host, endpoint_host) != 0) {
+        snprintf(endpoint_host, sizeof(endpoint_host), "%s", host);
+        endpoint_port = port;
+        resolved_count = 0;
+        memset(&last_good, 0, sizeof(last_good));
+        load_cache();
+    }
+    if(resolving || (resolved_count > 0 && endpoint_ms(CLOCK_MONOTONIC) - resolved_at_ms < RESOLVE_REFRESH_MS)) return;
+    pthread_t resolver;
+    if(pthread_create(&resolver, NULL, thread_resolve_action, NULL) == 0) {
+        pthread_detach(resolver);
+        resolving = 1;
+    }
+}
+
+void endpoint_prefetch(const char* host, int port) {
+    pthread_mutex_lock(&endpoint_lock);
+    start_resolving(host, port);
+    pthread_mutex_unlock(&endpoint_lock);
+}
+
+// The last good address, then the resolved ones alternating between families.
+int candidates(struct address* out) {
+    int count = 0;
+    if(last_good.length > 0) out[count++] = last_good;
+    int taken[MAX_ADDRESSES] = { 0 };
+    int family = resolved_count > 0 ? resolved[0].storage.ss_family : AF_UNSPEC;
+    while(count < MAX_ADDRESSES) {
+        int next = -1;
+        for(int i = 0; i < resolved_count && next == -1; i++) {
+            if(!taken[i] && resolved[i].storage.ss_family == family) next = i;
+        }
+        for(int i = 0; i < resolved_count && next == -1; i++) {
+            if(!taken[i]) next = i;
+        }
+        if(next == -1) break;
+        taken[next] = 1;
+        family = resolved[next].storage.ss_family == AF_INET6 ? AF_INET : AF_INET6;
+        if(last_good.length == 0 || !same_address(&resolved[next], &last_good)) out[count++] = resolved[next];
+    }
+    return count;
+}
+
+// Returns the index of the address that connected first, with its socket in *fd, or -1.
+int race(const struct address* addresses, int count, int* fd) {
+    struct pollfd attempts[MAX_ADDRESSES];
+    int attempt_index[MAX_ADDRESSES];
+    int open = 0;
+    int started = 0;
+    int winner = -1;
+    int last_error = ETIMEDOUT;
+    long deadline = endpoint_ms(CLOCK_MONOTONIC) + CONNECT_TIMEOUT_MS;
+    long next_start = 0;
+
+    while(winner == -1) {
+        long now = endpoint_ms(CLOCK_MONOTONIC);
+        if(started < count && (now >= next_start || open == 0)) {
+            const struct address* address = &addresses[started];
+            int attempt = socket(address->storage.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if(attempt >= 0 && connect(attempt, (struct sockaddr*) &address->storage, address->length) == 0) {
+                *fd = attempt;
+                winner = started;
+            } else if(attempt >= 0 && errno == EINPROGRESS) {
+                attempts[open].fd = attempt;
+                attempts[open].events = POLLOUT;
+                attempt_index[open++] = started;
+                next_start = now + ATTEMPT_DELAY_MS;
+            } else {
+                // a failed attempt lets the next one go at once
+                last_error = errno;
+                if(attempt >= 0) close(attempt);
+                next_start = now;
+            }
+            started++;
+            continue;
+        }
+        if(open == 0 || now >= deadline) break;
+
+        long wake = started < count && next_start < deadline ? next_start : deadline;
+        if(poll(attempts, open, wake - now) < 0 && errno != EINTR) break;
+        for(int i = open - 1; i >= 0; i--) {
+            if(attempts[i].revents == 0) continue;
+            int error = 0;
+            socklen_t length = sizeof(error);
+            getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &error, &length);
+            if(error == 0 && winner == -1) {
+                *fd = attempts[i].fd;
+                winner = attempt_index[i];
+            } else {
+                if(error != 0) last_error = error;
+                close(attempts[i].fd);
+                next_start = now;
+            }
+            attempts[i] = attempts[--open];
+            attempt_index[i] = attempt_index[open];
+        }
+    }
+
+    for(int i = 0; i < open; i++) close(attempts[i].fd);
+    if(winner == -1) errno = last_error;
+    return winner;
+}
+
+void tune(int fd) {
+    int on = 1;
+    int idle = 30;
+    int interval = 10;
+    int probes = 3;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+}
+
+int endpoint_connect(const char* host, int port) {
+    struct address addresses[MAX_ADDRESSES];
+    pthread_mutex_lock(&endpoint_lock);
+    start_resolving(host, port);
+    if(last_good.length == 0 && resolved_count == 0 && resolving) {
+        long give_up = endpoint_ms(CLOCK_REALTIME) + RESOLVE_WAIT_MS;
+        struct timespec until = { give_up / 1000, (give_up % 1000) * 1000000 };
+        while(resolved_count == 0 && resolving) {
+            if(pthread_cond_timedwait(&endpoint_resolved, &endpoint_lock, &until) == ETIMEDOUT) break;
+        }
+    }
+    int count = candidates(addresses);
+    pthread_mutex_unlock(&endpoint_lock);
+    if(count == 0) {
+        fprintf(stderr, "ERROR no address for %s yet \n", host);
+        return -1;
+    }
+
+    int fd = -1;
+    int winner = race(addresses, count, &fd);
+    if(winner == -1) {
+        fprintf(stderr, "ERROR connecting to %s due to error %s \n", host, strerror(errno));
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    tune(fd);
+
+    pthread_mutex_lock(&endpoint_lock);
+    if(!same_address(&addresses[winner], &last_good)) {
+        last_good = addresses[winner];
+        save_cache();
+    }
+    pthread_mutex_unlock(&endpoint_lock);
+    return fd;
+}
@@ -0,0 +1,32 @@
+#ifndef ENDPOINT_H
+#define ENDPOINT_H
+
+/*
+ * Where the server is and how to get a socket to it. Names are resolved
+ * with getaddrinfo on a background thread, so a slow DNS server only delays
+ * the very first connect, and by at most RESOLVE_WAIT_MS. Every later
+ * connect uses the addresses already known and starts a fresh lookup in
+ * the background once they are RESOLVE_REFRESH_MS old.
+ *
+ * The addresses are raced in the style of RFC 8305: the last address that
+ * worked goes first, the rest alternate between IPv6 and IPv4, and a new
+ * attempt starts every ATTEMPT_DELAY_MS, or as soon as one fails, until one
+ * connects. CONNECT_TIMEOUT_MS bounds the whole race.
+ *
+ * The address that worked is remembered, and written to the cache file if
+ * one is set, so a restart can connect before DNS has answered. The winning
+ * socket is blocking, with Nagle off (reports are batched before they are
+ * written) and keepalive probes that notice a dead server within a minute.
+ */
+#define RESOLVE_WAIT_MS 5000
+#define RESOLVE_REFRESH_MS 60000
+#define ATTEMPT_DELAY_MS 250
+#define CONNECT_TIMEOUT_MS 5000
+
+void endpoint_set_cache(const char* path);
+// Starts resolving host ahead of the first connect.
+void endpoint_prefetch(const char* host, int port);
+// Returns a connected socket, or -1.
+int endpoint_connect(const char* host, int port);
+
+#endif
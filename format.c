@@ -0,0 +1,92 @@
+#include <math.h>
+#include <string.h>
+
+#include "format.h"
+
+__thread time_t cached_second = -1;
+__thread char cached_clock[8];
+
+static inline void two_digits(char* out, int value) {
+    out[0] = '0' + value / 10;
+    out[1] = '0' + value % 10;
+}
+
+static inline int format_clock(char* out, time_t when) {
+    if(when != cached_second) {
+        struct tm info;
+        localtime_r(&when, &info);
+        two_digits(cached_clock, info.tm_hour);
+        cached_clock[2] = ':';
+        two_digits(cached_clock + 3, info.tm_min);
+        cached_clock[5] = ':';
+        two_digits(cached_clock + 6, info.tm_sec);
+        cached_second = when;
+    }
+    memcpy(out, cached_clock, 8);
+    return 8;
+}
+
+// Same output as "%0.1f": ties go to even on the exact value of the float, and
+// a negative value that rounds to zero keeps its sign.
+static inline int format_tenths(char* out, float value) {
+    // exact, a float's 24 bit mantissa times ten fits in a double
+    double scaled = (double) value * 10;
+    long tenths = (long) scaled;
+    double rest = scaled - tenths;
+    if(rest > 0.5 || (rest == 0.5 && (tenths & 1))) tenths++;
+    if(rest < -0.5 || (rest == -0.5 && (tenths & 1))) tenths--;
+    int length = 0;
+    if(signbit(value)) {
+        out[length++] = '-';
+        tenths = -tenths;
+    }
+    char digits[12];
+    int whole = tenths / 10;
+    int count = 0;
+    do {
+        digits[count++] = '0' + whole % 10;
+        whole /= 10;
+    } while(whole > 0);
+    while(count > 0) {
+        out[length++] = digits[--count];
+    }
+    out[length++] = '.';
+    out[length++] = '0' + tenths % 10;
+    return length;
+}
+
+int format_report(char* out, time_t when, const float* temperatures, int n) {
+    int length = format_clock(out, when);
+    for(int i = 0; i < n; i++) {
+        out[length++] = ' ';
+        length += format_tenths(out + length, temperatures[i]);
+    }
+    out[length++] = '\n';
+    return length;
+}
+
+int format_history(char* out, int64_t when_ms, const float* temperatures, int n) {
+    memcpy(out, "HISTORY ", 8);
+    int length = 8;
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = '0' + when_ms % 10;
+        when_ms /= 10;
+    } while(when_ms > 0);
+    while(count > 0) {
+        out[length++] = digits[--count];
+    }
+    for(int i = 0; i < n; i++) {
+        out[length++] = ' ';
+        length += format_tenths(out + length, temperatures[i]);
+    }
+    out[length++] = '\n';
+    return length;
+}
+
+int format_shutdown(char* out, time_t when) {
+    int length = format_clock(out, when);
+    memcpy(out + length, " SHUTDOWN\n", 10);
+    return length + 10;
+}
@@ -0,0 +1,19 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define FORMAT_LINE_MAX 96
+
+/*
+ * Renders "HH:MM:SS T0 T1 ...\n" without sprintf. The broken-down time is
+ * cached per thread and only recomputed when the second changes, and the
+ * temperatures are printed from integer tenths. Returns the length.
+ */
+int format_report(char* out, time_t when, const float* temperatures, int n);
+int format_shutdown(char* out, time_t when);
+// "HISTORY MS T0 T1 ...\n", one sample of a HISTORY= reply with its time in ms since the epoch.
+int format_history(char* out, int64_t when_ms, const float* temperatures, int n);
+
+#endif
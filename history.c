@@ -0,0 +1,128 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "history.h"
+
+#define HISTORY_MAGIC 0x4c344843
+#define HISTORY_VERSION 1
+#define HISTORY_HEADER_SIZE 4096
+
+struct history_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t channels;
+    uint64_t capacity;
+    _Atomic uint64_t written;
+};
+
+struct history_header* history_header = NULL;
+struct history_record* history_records = NULL;
+uint64_t history_capacity = 0;
+size_t history_map_size = 0;
+
+int history_open(const char* path, long capacity, int channels) {
+    if(capacity < 1) {
+        fprintf(stderr, "The history needs room for at least one record \n");
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd == -1) {
+        fprintf(stderr, "Opening the history %s failed %s \n", path, strerror(errno));
+        return -1;
+    }
+    size_t size = HISTORY_HEADER_SIZE + capacity * sizeof(struct history_record);
+    struct stat info;
+    int reused = fstat(fd, &info) == 0 && info.st_size == (off_t) size;
+    // allocating up front means a full disk fails here and not as a SIGBUS in the report thread
+    int status = reused ? 0 : ftruncate(fd, 0) == 0 ? posix_fallocate(fd, 0, size) : errno;
+    if(status != 0) {
+        fprintf(stderr, "Sizing the history %s failed %s \n", path, strerror(status));
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) {
+        fprintf(stderr, "Mapping the history %s failed %s \n", path, strerror(errno));
+        return -1;
+    }
+
+    history_header = map;
+    history_records = (struct history_record*) ((char*) map + HISTORY_HEADER_SIZE);
+    history_capacity = capacity;
+    history_map_size = size;
+    if(history_header->magic != HISTORY_MAGIC || history_header->version != HISTORY_VERSION
+       || history_header->record_size != sizeof(struct history_record)
+       || history_header->channels != (uint32_t) channels || history_header->capacity != (uint64_t) capacity) {
+        history_header->magic = HISTORY_MAGIC;
+        history_header->version = HISTORY_VERSION;
+        history_header->record_size = sizeof(struct history_record);
+        history_header->channels = channels;
+        history_header->capacity = capacity;
+        atomic_store(&history_header->written, 0);
+    }
+    return 0;
+}
+
+int history_enabled() {
+    return history_header != NULL;
+}
+
+void history_append(int64_t when_ns, const int* raw) {
+    if(history_header == NULL) return;
+    uint64_t written = atomic_load_explicit(&history_header->written, memory_order_relaxed);
+    struct history_record* record = &history_records[written % history_capacity];
+    record->when_ns = when_ns;
+    memcpy(record->raw, raw, history_header->channels * sizeof(int));
+    atomic_store_explicit(&history_header->written, written + 1, memory_order_release);
+}
+
+uint64_t history_find(int64_t from_ns) {
+    if(history_header == NULL) return 0;
+    uint64_t high = atomic_load_explicit(&history_header->written, memory_order_acquire);
+    uint64_t low = high > history_capacity ? high - history_capacity : 0;
+    while(low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if(history_records[middle % history_capacity].when_ns < from_ns) low = middle + 1; else high = middle;
+    }
+    return low;
+}
+
+int history_read(uint64_t* next, int64_t to_ns, struct history_record* out, int max) {
+    if(history_header == NULL) return 0;
+    uint64_t written = atomic_load_explicit(&history_header->written, memory_order_acquire);
+    // whatever the writer has lapped is gone
+    if(written > history_capacity && *next < written - history_capacity) *next = written - history_capacity;
+    uint64_t first = *next;
+    int count = 0;
+    while(count < max && first + count < written) {
+        out[count] = history_records[(first + count) % history_capacity];
+        if(out[count].when_ns >= to_ns) break;
+        count++;
+    }
+
+    // a slot is safe if the writer had not started on the record that replaces it
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t now_written = atomic_load_explicit(&history_header->written, memory_order_relaxed);
+    uint64_t lapped = now_written >= history_capacity ? now_written - history_capacity + 1 : 0;
+    int skip = first < lapped ? (lapped - first < (uint64_t) count ? (int) (lapped - first) : count) : 0;
+    memmove(out, out + skip, (count - skip) * sizeof(struct history_record));
+    *next = first + count;
+    if(count > 0 && count == skip) {
+        // everything copied was overwritten, carry on from the new oldest record
+        return history_read(next, to_ns, out, max);
+    }
+    return count - skip;
+}
+
+// The report thread may still be appending, so the mapping stays until exit.
+void history_close() {
+    if(history_header != NULL) msync(history_header, history_map_size, MS_ASYNC);
+}
@@ -0,0 +1,40 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+#include "sensor.h"
+
+#define DEFAULT_HISTORY_RECORDS 65536
+
+struct history_record {
+    // wall clock time of the sampling deadline
+    int64_t when_ns;
+    int raw[MAX_CHANNELS];
+};
+
+/*
+ * On-device sample history: a memory-mapped circular file of fixed size
+ * records holding every sample's raw ADC values and time. The report thread
+ * appends each sample it takes off the ring, and HISTORY= reads ranges back
+ * without going near the text log.
+ *
+ * A header page holds the layout and the number of records ever written;
+ * record n lives in slot n % capacity. Reopening a file with the same layout
+ * carries on after the last record, so the history survives restarts, and
+ * any other layout starts it over.
+ *
+ * There is one writer. A reader copies records and then checks the writer
+ * has not lapped them meanwhile, dropping the ones it has.
+ */
+int history_open(const char* path, long capacity, int channels);
+int history_enabled(void);
+void history_append(int64_t when_ns, const int* raw);
+// The sequence number of the first record at or after from_ns.
+uint64_t history_find(int64_t from_ns);
+// Copies up to max records from *next on that are before to_ns and advances
+// *next past them. Returns how many, 0 once the range is done.
+int history_read(uint64_t* next, int64_t to_ns, struct history_record* out, int max);
+void history_close(void);
+
+#endif
@@ -0,0 +1,1093 @@
+#include <pthread.h>
+#include <stdio.h> //for printing
+#include <stdlib.h> 
+#include <time.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h> 
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/types.h> 
+#include <stdlib.h>
+#include <math.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include<unistd.h>
+
+#include "sensor.h"
+#include "thermistor.h"
+#include "spool.h"
+#include "logwriter.h"
+#include "format.h"
+#include "encode.h"
+#include "compress.h"
+#include "reduce.h"
+#include "ring.h"
+#include "metrics.h"
+#include "button.h"
+#include "history.h"
+#include "endpoint.h"
+#include "transport.h"
+#include "parser.h"
+#include "lab4c.h"
+
+
+
+// shared between the command handler, the acquisition thread and the report thread
+_Atomic double period_interval = 1.0;
+atomic_int period_changed = 0;
+// the sampler sleeps on its timer and on period_wake_fd, which PERIOD= writes to
+int sample_timer_fd = -1;
+int period_wake_fd = -1;
+atomic_long missed_deadlines = 0;
+atomic_int use_farenheight = 1;
+atomic_int should_stop = 0;
+int button_fd = -1;
+atomic_int exit_flag = 0;
+int id = -1;
+char* host = NULL;
+int port_no = -1;
+struct transport* transport = NULL;
+struct connection server = { -1, NULL, NULL };
+int channels[MAX_CHANNELS] = { 0 };
+int num_channels = 1;
+struct reducer reducer;
+struct sample_ring samples;
+pthread_t temp_thread;
+pthread_t report_thread;
+int sampling = 0;
+
+#define MIN_PERIOD 0.001
+#define MAX_BATCH 256
+#define REPORT_LINE_MAX FORMAT_LINE_MAX
+int batch_size = 1;
+int flush_ms = 0;
+char batch_buffer[MAX_BATCH * REPORT_LINE_MAX];
+int batch_len = 0;
+int batch_count = 0;
+struct timespec batch_started;
+pthread_mutex_t batch_lock = PTHREAD_MUTEX_INITIALIZER;
+// fires when the oldest queued report reaches flush_ms, so a batch that stops growing still goes out
+int flush_timer_fd = -1;
+// with --encoding=binary the batch goes out as one record, batch_buffer still feeds the log
+int use_binary = 0;
+struct report_encoder encoder;
+char encoded[ENCODE_RECORD_MAX];
+
+#define OUT_QUEUE_SIZE (64 * 1024)
+char out_queue[OUT_QUEUE_SIZE];
+int out_len = 0;
+int write_retry_len = 0;
+int write_blocked = 0;
+// a TLS write that has to read first, retried once the socket is readable
+int write_wants_read = 0;
+long dropped_bytes = 0;
+// set from the first drop until a report gets queued again, so an outage is reported once
+int dropping = 0;
+int wake_fds[2] = { -1, -1 };
+pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+int connected = 0;
+
+// with --compression=deflate the queue goes through the compressor into wire_queue,
+// which is what gets written. Input the compressor holds back is flushed one
+// sampling period after it was taken, at once if --flush-ms bounds the latency.
+int use_compression = 0;
+struct compressor compressor;
+char wire_queue[OUT_QUEUE_SIZE];
+int wire_len = 0;
+int compress_held = 0;
+int compress_due = 0;
+int compress_timer_fd = -1;
+
+// a HISTORY= reply in progress, fed to the queue by the event loop as it drains
+#define HISTORY_CHUNK 64
+int history_replying = 0;
+uint64_t history_next = 0;
+int64_t history_to_ns = 0;
+struct report_encoder history_encoder;
+char history_encoded[ENCODE_RECORD_MAX];
+
+#define MIN_BACKOFF_MS 500
+#define MAX_BACKOFF_MS 60000
+#define DEFAULT_SPOOL_SIZE (1024 * 1024)
+
+
+#define NSEC_PER_SEC 1000000000LL
+
+int64_t clock_ns(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (int64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+int64_t period_ns() {
+    return (int64_t)(period_interval * NSEC_PER_SEC);
+}
+
+// Hands bytes to the event loop, which is the only thread that touches the socket.
+void enqueue_output(const char* data, int length) {
+    pthread_mutex_lock(&out_lock);
+    // anything already spooled is older, so new reports queue up behind it
+    if(spool_enabled() && (!connected || spool_size() > 0 || out_len + length > OUT_QUEUE_SIZE)
+       && spool_append(data, length) == 0) {
+        pthread_mutex_unlock(&out_lock);
+        write(wake_fds[1], "", 1);
+        return;
+    }
+    if(!connected || out_len + length > OUT_QUEUE_SIZE) {
+        dropped_bytes += length;
+        metric_add(METRIC_DROPPED_BYTES, length);
+        if(!dropping) fprintf(stderr, "Server unreachable or too slow, dropping reports \n");
+        dropping = 1;
+        pthread_mutex_unlock(&out_lock);
+        return;
+    }
+    if(dropping) {
+        fprintf(stderr, "Sending again, dropped %ld bytes in total \n", dropped_bytes);
+        dropping = 0;
+    }
+    memcpy(out_queue + out_len, data, length);
+    out_len += length;
+    pthread_mutex_unlock(&out_lock);
+    write(wake_fds[1], "", 1);
+}
+
+// Moves what fits of the queue through the compressor into wire_queue. Caller holds out_lock.
+void compress_output() {
+    int flush = compress_due || flush_ms > 0;
+    while(out_len > 0 || (flush && compress_held)) {
+        int used;
+        int produced = compressor_write(&compressor, out_queue, out_len, &used, wire_queue + wire_len, OUT_QUEUE_SIZE - wire_len, flush);
+        wire_len += produced;
+        if(used > 0) {
+            memmove(out_queue, out_queue + used, out_len - used);
+            out_len -= used;
+            if(!compress_held && !flush) {
+                int64_t hold = period_ns();
+                struct itimerspec flush_at = { { 0, 0 }, { hold / NSEC_PER_SEC, hold % NSEC_PER_SEC } };
+                timerfd_settime(compress_timer_fd, 0, &flush_at, NULL);
+            }
+            compress_held = 1;
+        }
+        if(flush && out_len == 0 && wire_len < OUT_QUEUE_SIZE) {
+            compress_held = 0;
+            compress_due = 0;
+        }
+        // the wire queue is full
+        if(produced == 0 && used == 0) break;
+    }
+}
+
+// Writes as much of the queue as the socket takes without blocking.
+// Returns -1 when the connection is gone.
+int drain_output() {
+    int status = 0;
+    pthread_mutex_lock(&out_lock);
+    char* queue = use_compression ? wire_queue : out_queue;
+    int* queue_len = use_compression ? &wire_len : &out_len;
+    if(use_compression) compress_output();
+    while(*queue_len > 0) {
+        int length = write_retry_len > 0 ? write_retry_len : *queue_len;
+        int64_t started = clock_ns(CLOCK_MONOTONIC);
+        int written = transport->write(&server, queue, length);
+        metric_record(HISTOGRAM_WRITE, clock_ns(CLOCK_MONOTONIC) - started);
+        metric_add(METRIC_WRITES, 1);
+        if(written == TRANSPORT_WANT_WRITE || written == TRANSPORT_WANT_READ) {
+            metric_add(METRIC_WOULD_BLOCK, 1);
+            // a TLS retry has to repeat the same length
+            write_retry_len = length;
+            write_blocked = written == TRANSPORT_WANT_WRITE;
+            write_wants_read = written == TRANSPORT_WANT_READ;
+            break;
+        }
+        if(written < 0) {
+            status = -1;
+            break;
+        }
+        metric_add(METRIC_BYTES_SENT, written);
+        write_retry_len = 0;
+        write_blocked = 0;
+        write_wants_read = 0;
+        memmove(queue, queue + written, *queue_len - written);
+        *queue_len -= written;
+        if(use_compression) compress_output();
+    }
+    pthread_mutex_unlock(&out_lock);
+    return status;
+}
+
+// Gives the queue a couple of seconds to reach the server before exiting.
+void finish_output() {
+    if(!connected) return;
+    int64_t give_up = clock_ns(CLOCK_MONOTONIC) + 2 * NSEC_PER_SEC;
+    compress_due = 1;
+    if(drain_output() < 0) return;
+    while((out_len > 0 || wire_len > 0 || compress_held) && clock_ns(CLOCK_MONOTONIC) < give_up) {
+        struct pollfd socket_poll = { server.fd, POLLIN | POLLOUT, 0 };
+        poll(&socket_poll, 1, 100);
+        compress_due = 1;
+        if(drain_output() < 0) return;
+    }
+}
+
+void shutdown_program() {
+
+    // the acquisition thread may be asleep for a whole period, do not wait for it to notice exit_flag
+    if(sampling) {
+        pthread_cancel(temp_thread);
+        pthread_join(temp_thread, NULL);
+        // the report thread writes to the spool, the history and the log, so it goes before they close
+        ring_close(&samples);
+        pthread_join(report_thread, NULL);
+    }
+    finish_output();
+    button_close(button_fd);
+    sensor_close();
+    spool_close();
+    history_close();
+    log_close();
+    exit(0);
+
+}
+void initalize_hardware(char* sensor_spec) {
+
+    if(sensor_open(sensor_spec) != 0) {
+        exit(2);
+    }
+    if(!sensor->has_hardware) return;
+
+    // the button is on GPIO1_18
+    button_fd = button_open(1, 18);
+    if(button_fd == -1) {
+        fprintf(stderr, "Failed init event \n");
+        exit(2);
+    }
+}
+
+long elapsed_ms(struct timespec* since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+// Sends every queued report as one write. Caller holds batch_lock.
+void flush_batch() {
+    if(batch_len == 0) return;
+    if(use_binary) {
+        enqueue_output(encoded, encoder_finish(&encoder, encoded));
+    } else {
+        enqueue_output(batch_buffer, batch_len);
+    }
+    log_write(batch_buffer, batch_len);
+    batch_len = 0;
+    batch_count = 0;
+}
+
+void queue_report(char* line, int length, int64_t when_ms, const float* temperatures, int fahrenheit) {
+    pthread_mutex_lock(&batch_lock);
+    if(use_binary && encoder_add(&encoder, when_ms, temperatures, fahrenheit) != 0) {
+        // a record holds one scale, so a SCALE= change starts a new one
+        flush_batch();
+        encoder_add(&encoder, when_ms, temperatures, fahrenheit);
+    }
+    if(batch_count == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &batch_started);
+        if(flush_timer_fd != -1) {
+            struct itimerspec flush_at = { { 0, 0 }, { flush_ms / 1000, (flush_ms % 1000) * 1000000L } };
+            timerfd_settime(flush_timer_fd, 0, &flush_at, NULL);
+        }
+    }
+    memcpy(batch_buffer + batch_len, line, length);
+    batch_len += length;
+    batch_count ++;
+
+    // flush now if holding the batch until the next sample would break the latency bound
+    int full = batch_count >= batch_size || batch_count >= MAX_BATCH;
+    int too_old = flush_ms > 0 && elapsed_ms(&batch_started) + period_interval * 1000 > flush_ms;
+    if(full || too_old) {
+        flush_batch();
+    }
+    pthread_mutex_unlock(&batch_lock);
+}
+
+// Sleeps until the deadline, or until a PERIOD= change moves it to one period
+// after the last sample, at once if that has passed.
+int64_t sleep_until(int64_t deadline, int64_t last_sample) {
+    struct pollfd waits[2] = { { sample_timer_fd, POLLIN, 0 }, { period_wake_fd, POLLIN, 0 } };
+    while(1) {
+        struct itimerspec wakeup = { { 0, 0 }, { deadline / NSEC_PER_SEC, deadline % NSEC_PER_SEC } };
+        timerfd_settime(sample_timer_fd, TFD_TIMER_ABSTIME, &wakeup, NULL);
+        while(poll(waits, 2, -1) < 0);
+        uint64_t count;
+        if(waits[0].revents & POLLIN) {
+            read(sample_timer_fd, &count, sizeof(count));
+            return deadline;
+        }
+        read(period_wake_fd, &count, sizeof(count));
+        if(atomic_exchange(&period_changed, 0)) {
+            int64_t now = clock_ns(CLOCK_MONOTONIC);
+            deadline = last_sample + period_ns();
+            if(deadline < now) deadline = now;
+        }
+    }
+}
+
+// Reads the ADC on an absolute grid of CLOCK_MONOTONIC deadlines and only
+// hands the raw values to the report thread, so converting, formatting and a
+// stalled network can not push later samples back.
+void* thread_temperature_action() {
+    int64_t deadline = clock_ns(CLOCK_MONOTONIC);
+
+    while(1) {
+        struct raw_sample sample;
+        sample.deadline_ns = deadline;
+        int64_t started = clock_ns(CLOCK_MONOTONIC);
+        metric_record(HISTOGRAM_JITTER, started - deadline);
+        sensor_read_channels(channels, sample.raw, num_channels);
+        int64_t now = clock_ns(CLOCK_MONOTONIC);
+        metric_record(HISTOGRAM_SENSOR_READ, now - started);
+        metric_add(METRIC_SAMPLES, 1);
+        if(ring_push(&samples, &sample) != 0) {
+            metric_add(METRIC_OVERRUNS, 1);
+        }
+
+        if(atomic_exchange(&period_changed, 0)) {
+            deadline = now;
+        }
+        deadline += period_ns();
+        if(now > deadline) {
+            long missed = (now - deadline) / period_ns() + 1;
+            deadline += missed * period_ns();
+            missed_deadlines += missed;
+            metric_add(METRIC_MISSED_DEADLINES, missed);
+        }
+
+        deadline = sleep_until(deadline, now);
+        if(exit_flag == 1) {
+            pthread_exit(0);
+        }
+    }
+}
+
+// Turns raw samples from the ring into reports: conversion, reduction,
+// formatting and batching.
+void* thread_report_action() {
+    int reduced_scale = use_farenheight;
+    long reported_missed = 0;
+    long reported_overruns = 0;
+
+    // nothing is reported after the SHUTDOWN line
+    while(exit_flag == 0) {
+        struct raw_sample sample;
+        if(!ring_pop(&samples, &sample)) {
+            if(ring_wait(&samples) < 0) break;
+            continue;
+        }
+
+        // taken again for every sample, a board without an RTC boots in 1970 until NTP steps the clock
+        int64_t wall_offset = clock_ns(CLOCK_REALTIME) - clock_ns(CLOCK_MONOTONIC);
+        int64_t when_ns = sample.deadline_ns + wall_offset;
+        history_append(when_ns, sample.raw);
+
+        float temperatures[MAX_CHANNELS];
+        int fahrenheit = use_farenheight;
+        thermistor_convert(sample.raw, temperatures, num_channels, fahrenheit);
+        // a window or deadband must not mix scales, and nothing carries over a STOP
+        if(fahrenheit != reduced_scale || should_stop) {
+            reducer_reset(&reducer);
+            reduced_scale = fahrenheit;
+        }
+        float reported[MAX_CHANNELS];
+        if(should_stop ==0 && reducer_add(&reducer, temperatures, reported)) {
+            char buffer[REPORT_LINE_MAX];
+            int64_t started = clock_ns(CLOCK_MONOTONIC);
+            int length = format_report(buffer, when_ns / NSEC_PER_SEC, reported, num_channels);
+            metric_record(HISTOGRAM_FORMAT, clock_ns(CLOCK_MONOTONIC) - started);
+            metric_add(METRIC_REPORTS, 1);
+            queue_report(buffer, length, when_ns / 1000000, reported, fahrenheit);
+        }
+
+        long missed = missed_deadlines;
+        if(missed != reported_missed) {
+            fprintf(stderr, "Missed %ld sampling deadline(s), %ld in total \n", missed - reported_missed, missed);
+            reported_missed = missed;
+        }
+        long overruns = atomic_load(&samples.overruns);
+        if(overruns != reported_overruns) {
+            fprintf(stderr, "The sample ring overran, dropped %ld sample(s), %ld in total \n", overruns - reported_overruns, overruns);
+            reported_overruns = overruns;
+        }
+    }
+    return NULL;
+}
+
+void report_shutdown() {
+    char shutdown_buffer[REPORT_LINE_MAX];
+    int length = format_shutdown(shutdown_buffer, time(0));
+    if(use_binary) {
+        char record[32];
+        enqueue_output(record, encode_shutdown(record, id, clock_ns(CLOCK_REALTIME) / 1000000));
+    } else {
+        enqueue_output(shutdown_buffer, length);
+    }
+
+    log_write(shutdown_buffer, length);
+}
+
+// HISTORY=FROM,TO in seconds since the epoch, where 0 or less counts back from now.
+// TO defaults to now. Only the range is worked out here, pump_history sends it.
+void start_history(const char* argument) {
+    char* end;
+    int64_t now_ns = clock_ns(CLOCK_REALTIME);
+    double from = strtod(argument, &end);
+    double to = *end == ',' ? strtod(end + 1, NULL) : 0;
+    int64_t from_ns = from <= 0 ? now_ns + (int64_t) (from * NSEC_PER_SEC) : (int64_t) (from * NSEC_PER_SEC);
+    history_to_ns = to <= 0 ? now_ns + (int64_t) (to * NSEC_PER_SEC) : (int64_t) (to * NSEC_PER_SEC);
+    history_next = history_find(from_ns);
+    history_encoder.type = RECORD_HISTORY;
+    history_replying = history_enabled();
+}
+
+// Queues the next stretch of the HISTORY= reply while the queue is under half
+// full and the spool is empty, so live reports always have room and a reply
+// never goes into the spool, where it would push out unsent reports. Binary
+// replies are HISTORY records, text replies one format_history line per sample.
+void pump_history() {
+    struct history_record records[HISTORY_CHUNK];
+    char chunk[HISTORY_CHUNK * REPORT_LINE_MAX];
+    int fahrenheit = use_farenheight;
+    while(history_replying) {
+        pthread_mutex_lock(&out_lock);
+        int room = connected && out_len < OUT_QUEUE_SIZE / 2 && spool_size() == 0;
+        pthread_mutex_unlock(&out_lock);
+        if(!room) return;
+
+        int count = history_read(&history_next, history_to_ns, records, HISTORY_CHUNK);
+        int length = 0;
+        for(int r = 0; r < count; r++) {
+            float temperatures[MAX_CHANNELS];
+            thermistor_convert(records[r].raw, temperatures, num_channels, fahrenheit);
+            int64_t when_ms = records[r].when_ns / 1000000;
+            if(!use_binary) {
+                length += format_history(chunk + length, when_ms, temperatures, num_channels);
+            } else if(encoder_add(&history_encoder, when_ms, temperatures, fahrenheit) != 0) {
+                enqueue_output(history_encoded, encoder_finish(&history_encoder, history_encoded));
+                encoder_add(&history_encoder, when_ms, temperatures, fahrenheit);
+            }
+        }
+        if(length > 0) enqueue_output(chunk, length);
+        if(count == 0) {
+            length = use_binary ? encoder_finish(&history_encoder, history_encoded) : 0;
+            if(length > 0) enqueue_output(history_encoded, length);
+            history_replying = 0;
+        }
+    }
+}
+
+void run_command(char* buffer, int length) {
+    const char* argument = NULL;
+
+    switch(command_lookup(buffer, length, &argument)) {
+        case COMMAND_PERIOD: {
+            double new_period = atof(argument);
+            if(new_period >= MIN_PERIOD) {
+                period_interval = new_period;
+                period_changed = 1;
+                uint64_t one = 1;
+                write(period_wake_fd, &one, sizeof(one));
+            }
+            log_line(buffer, length);
+            break;
+        }
+        case COMMAND_BATCH: {
+            int new_size = atoi(argument);
+            if(new_size >= 1 && new_size <= MAX_BATCH) {
+                pthread_mutex_lock(&batch_lock);
+                batch_size = new_size;
+                if(batch_count >= batch_size) flush_batch();
+                pthread_mutex_unlock(&batch_lock);
+            }
+            log_line(buffer, length);
+            break;
+        }
+        case COMMAND_LOG:
+            log_line(buffer, length);
+            break;
+        case COMMAND_WINDOW: {
+            int new_window = atoi(argument);
+            if(new_window >= 1) reducer.window = new_window;
+            log_line(buffer, length);
+            break;
+        }
+        case COMMAND_REDUCE: {
+            int new_mode = reduce_parse_mode(argument);
+            if(new_mode != -1) reducer.mode = new_mode;
+            log_line(buffer, length);
+            break;
+        }
+        case COMMAND_DEADBAND: {
+            double new_deadband = atof(argument);
+            if(new_deadband >= 0) reducer.deadband = new_deadband;
+            log_line(buffer, length);
+            break;
+        }
+        case COMMAND_STOP:
+            log_line(buffer, length);
+            pthread_mutex_lock(&batch_lock);
+            flush_batch();
+            pthread_mutex_unlock(&batch_lock);
+            should_stop = 1;
+            break;
+        case COMMAND_SCALE_C:
+            log_line(buffer, length);
+            use_farenheight = 0;
+            break;
+        case COMMAND_SCALE_F:
+            log_line(buffer, length);
+            use_farenheight = 1;
+            break;
+        case COMMAND_START:
+            log_line(buffer, length);
+            should_stop = 0;
+            break;
+        case COMMAND_OFF:
+            log_line(buffer, length);
+
+            pthread_mutex_lock(&batch_lock);
+            flush_batch();
+            pthread_mutex_unlock(&batch_lock);
+
+            report_shutdown();
+            exit_flag = 1; 
+            shutdown_program();
+            break;
+        case COMMAND_HISTORY:
+            log_line(buffer, length);
+            start_history(argument);
+            break;
+        case COMMAND_UNKNOWN:
+            break;
+    }
+}
+
+void process_command(char* buffer, int length) {
+    int64_t started = clock_ns(CLOCK_MONOTONIC);
+    run_command(buffer, length);
+    metric_record(HISTOGRAM_COMMAND, clock_ns(CLOCK_MONOTONIC) - started);
+    metric_add(METRIC_COMMANDS, 1);
+}
+
+struct line_parser commands;
+
+// Returns -1 once the server has closed the connection.
+int read_commands() {
+    char read_buffer[4096];
+    while(1) {
+        int how_much_read = transport->read(&server, read_buffer, sizeof(read_buffer));
+        if(how_much_read == TRANSPORT_WANT_READ) return 0;
+        if(how_much_read == TRANSPORT_WANT_WRITE) {
+            write_blocked = 1;
+            return 0;
+        }
+        if(how_much_read < 0) {
+            printf("The server closed the connection\n");
+            return -1;
+        }
+        parser_feed(&commands, read_buffer, how_much_read, process_command);
+    }
+}
+
+// Opens a fresh connection and sends the ID= greeting. Returns -1 on any network
+// failure so the caller can back off and retry.
+int connect_to_server() {
+    char id_buffer[60];
+    snprintf(id_buffer, 60, "ID=%d\n%s%s", id, use_binary ? ENCODE_GREETING : "", use_compression ? COMPRESS_GREETING : "");
+    if(transport->open(&server, host, port_no, id_buffer, strlen(id_buffer)) != 0) {
+        return -1;
+    }
+    log_write(id_buffer, strlen(id_buffer));
+    return 0;
+}
+
+void disconnect() {
+    pthread_mutex_lock(&out_lock);
+    connected = 0;
+    write_blocked = 0;
+    write_wants_read = 0;
+    write_retry_len = 0;
+    // whatever the compressor held goes with the connection, like the socket buffer
+    if(use_compression) {
+        compressor_reset(&compressor);
+        wire_len = 0;
+        compress_held = 0;
+        compress_due = 0;
+    }
+    pthread_mutex_unlock(&out_lock);
+
+    transport->close(&server);
+    parser_reset(&commands);
+    history_replying = 0;
+}
+
+// Retries with exponential backoff plus jitter so a fleet does not reconnect in lockstep.
+void reconnect() {
+    int backoff_ms = MIN_BACKOFF_MS;
+    metric_add(METRIC_RECONNECTS, 1);
+    while(connect_to_server() != 0) {
+        int wait_ms = backoff_ms + rand() % (backoff_ms / 2 + 1);
+        fprintf(stderr, "Reconnecting in %d ms \n", wait_ms);
+        struct pollfd button_poll = { button_fd, POLLIN, 0 };
+        if(poll(&button_poll, 1, wait_ms) > 0 && (button_poll.revents & POLLIN) && button_pressed(button_fd)) {
+            report_shutdown();
+            exit_flag = 1;
+            shutdown_program();
+        }
+        backoff_ms = backoff_ms * 2 > MAX_BACKOFF_MS ? MAX_BACKOFF_MS : backoff_ms * 2;
+    }
+    pthread_mutex_lock(&out_lock);
+    connected = 1;
+    pthread_mutex_unlock(&out_lock);
+}
+
+// Once the live queue is empty, sends the oldest spooled reports. Transports that
+// can send from a file (tcp, unix, TLS with kTLS) take them straight from the
+// spool, the rest, and every compressed connection, get them copied into the
+// queue in one large chunk.
+// Returns -1 when the connection is gone.
+int refill_from_spool() {
+    int status = 0;
+    pthread_mutex_lock(&out_lock);
+    while(connected && out_len == 0 && spool_size() > 0) {
+        off_t offset;
+        long length;
+        int fd = spool_segment(&offset, &length);
+        int sent = use_compression ? TRANSPORT_UNSUPPORTED
+                   : transport->sendfile(&server, fd, offset, length > OUT_QUEUE_SIZE ? OUT_QUEUE_SIZE : length);
+        if(sent > 0) {
+            write_wants_read = 0;
+            metric_add(METRIC_BYTES_SENT, sent);
+            spool_consume(sent);
+        } else if(sent == 0) {
+            break;
+        } else if(sent == TRANSPORT_UNSUPPORTED) {
+            out_len = spool_peek(out_queue, OUT_QUEUE_SIZE);
+            spool_consume(out_len);
+        } else if(sent == TRANSPORT_WANT_WRITE || sent == TRANSPORT_WANT_READ) {
+            write_blocked = sent == TRANSPORT_WANT_WRITE;
+            write_wants_read = sent == TRANSPORT_WANT_READ;
+            break;
+        } else {
+            status = -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&out_lock);
+    return status;
+}
+
+// Appends the transport's long options to the ones every client understands.
+struct option* merge_options(const struct option* core, const struct option* extra) {
+    int core_count = 0;
+    int extra_count = 0;
+    while(core[core_count].name != NULL) core_count++;
+    while(extra != NULL && extra[extra_count].name != NULL) extra_count++;
+
+    struct option* merged = calloc(core_count + extra_count + 1, sizeof(struct option));
+    memcpy(merged, core, core_count * sizeof(struct option));
+    if(extra_count > 0) memcpy(merged + core_count, extra, extra_count * sizeof(struct option));
+    return merged;
+}
+
+int lab4c_main(int argc, char *argv[], struct transport* selected) {
+
+    srand(time(0));
+    transport = selected;
+
+
+    int curr_option;
+    const struct option core_options[] = {
+        { "scale",  required_argument, NULL,  's' },
+        { "period", required_argument, NULL,  'p' },
+     { "log", required_argument, NULL, 'l'},
+    { "id", required_argument, NULL, 'i'},
+    { "host", required_argument, NULL, 'h'},
+    { "batch", required_argument, NULL, 'b'},
+    { "flush-ms", required_argument, NULL, 'f'},
+    { "sensor", required_argument, NULL, 'S'},
+    { "spool", required_argument, NULL, 'P'},
+    { "log-commit-ms", required_argument, NULL, 'L'},
+    { "log-fsync", required_argument, NULL, 'Y'},
+    { "log-max-size", required_argument, NULL, 'M'},
+    { "spool-size", required_argument, NULL, 'Z'},
+    { "channels", required_argument, NULL, 'C'},
+    { "beta", required_argument, NULL, 'B'},
+    { "encoding", required_argument, NULL, 'e'},
+    { "window", required_argument, NULL, 'w'},
+    { "reduce", required_argument, NULL, 'r'},
+    { "deadband", required_argument, NULL, 'd'},
+    { "metrics-socket", required_argument, NULL, 'm'},
+    { "history", required_argument, NULL, 'H'},
+    { "history-records", required_argument, NULL, 'R'},
+    { "address-cache", required_argument, NULL, 'A'},
+    { "compression", required_argument, NULL, 'z'},
+        { 0, 0, 0, 0}
+    };
+    struct option* options = merge_options(core_options, transport->options);
+
+
+    char* log_name = NULL;
+    char* spool_name = NULL;
+    int window = 1;
+    int reduce_mode = REDUCE_MEAN;
+    double deadband = 0;
+    char* metrics_socket = NULL;
+    char* history_name = NULL;
+    long history_records = DEFAULT_HISTORY_RECORDS;
+    int log_commit_ms = 250;
+    int log_fsync_policy = LOG_FSYNC_NEVER;
+    int log_fsync_ms = 0;
+    long log_max_size = 0;
+    long spool_capacity = DEFAULT_SPOOL_SIZE;
+    int beta = THERMISTOR_DEFAULT_BETA;
+#ifdef LAB4C_NO_HARDWARE
+    char* sensor_spec = "sim";
+#else
+    char* sensor_spec = "rc";
+#endif
+    while((curr_option = getopt_long(argc, argv, "c:p:s:t:l:o", options, NULL)) != -1)  {
+        switch(curr_option) {
+            case 's':
+                if(*optarg == 'F') {
+                    use_farenheight = 1;
+                } else if (*optarg == 'C') {
+                    use_farenheight = 0;
+                } else {
+                    fprintf(stderr, "You can only specify f or c for scale ");
+                    exit(1);
+                }
+                break;
+            case 'p':
+                period_interval = atof(optarg);
+                if(period_interval < MIN_PERIOD) {
+                    fprintf(stderr, "The period must be at least %g seconds \n", MIN_PERIOD);
+                    exit(1);
+                }
+                break;
+            case 'l':
+                log_name = optarg;
+                break;
+            case 'i':
+                id = atoi(optarg);
+                break;
+            case 'h':
+                host = optarg;
+                break;
+            case 'L':
+                log_commit_ms = atoi(optarg);
+                if(log_commit_ms <= 0) {
+                    fprintf(stderr, "The log commit interval must be positive \n");
+                    exit(1);
+                }
+                break;
+            case 'Y':
+                log_fsync_policy = log_parse_fsync(optarg, &log_fsync_ms);
+                if(log_fsync_policy == -1) {
+                    fprintf(stderr, "The log fsync policy is never, commit or an interval in ms \n");
+                    exit(1);
+                }
+                break;
+            case 'M':
+                log_max_size = atol(optarg);
+                break;
+            case 'P':
+                spool_name = optarg;
+                break;
+            case 'Z':
+                spool_capacity = atol(optarg);
+                if(spool_capacity < 4096) {
+                    fprintf(stderr, "The spool must be at least 4096 bytes \n");
+                    exit(1);
+                }
+                break;
+            case 'S':
+                sensor_spec = optarg;
+                break;
+            case 'C':
+                num_channels = sensor_parse_channels(optarg, channels);
+                if(num_channels == -1) {
+                    fprintf(stderr, "Channels must be a comma separated list of up to %d ADC channels from 0 to %d \n", MAX_CHANNELS, MAX_CHANNELS - 1);
+                    exit(1);
+                }
+                break;
+            case 'B':
+                beta = atoi(optarg);
+                if(beta <= 0) {
+                    fprintf(stderr, "The thermistor beta must be positive \n");
+                    exit(1);
+                }
+                break;
+            case 'e':
+                if(strcmp(optarg, "binary") == 0) {
+                    use_binary = 1;
+                } else if(strcmp(optarg, "text") != 0) {
+                    fprintf(stderr, "The encoding is text or binary \n");
+                    exit(1);
+                }
+                break;
+            case 'z':
+                if(strcmp(optarg, "deflate") == 0) {
+                    use_compression = 1;
+                } else if(strcmp(optarg, "none") != 0) {
+                    fprintf(stderr, "The compression is none or deflate \n");
+                    exit(1);
+                }
+                break;
+            case 'w':
+                window = atoi(optarg);
+                if(window < 1) {
+                    fprintf(stderr, "The window must be at least 1 sample \n");
+                    exit(1);
+                }
+                break;
+            case 'r':
+                reduce_mode = reduce_parse_mode(optarg);
+                if(reduce_mode == -1) {
+                    fprintf(stderr, "The reduction is mean, min, max or last \n");
+                    exit(1);
+                }
+                break;
+            case 'd':
+                deadband = atof(optarg);
+                if(deadband < 0) {
+                    fprintf(stderr, "The deadband can not be negative \n");
+                    exit(1);
+                }
+                break;
+            case 'm':
+                metrics_socket = optarg;
+                break;
+            case 'H':
+                history_name = optarg;
+                break;
+            case 'A':
+                endpoint_set_cache(optarg);
+                break;
+            case 'R':
+                history_records = atol(optarg);
+                if(history_records < 1) {
+                    fprintf(stderr, "The history must hold at least one record \n");
+                    exit(1);
+                }
+                break;
+            case 'b':
+                batch_size = atoi(optarg);
+                if(batch_size < 1 || batch_size > MAX_BATCH) {
+                    fprintf(stderr, "The batch size must be between 1 and %d \n", MAX_BATCH);
+                    exit(1);
+                }
+                break;
+            case 'f':
+                flush_ms = atoi(optarg);
+                if(flush_ms < 0) {
+                    fprintf(stderr, "The flush interval can not be negative \n");
+                    exit(1);
+                }
+                break;
+            default:
+                if(transport->parse_option != NULL && transport->parse_option(curr_option, optarg) == 0) {
+                    break;
+                }
+                fprintf(stderr, "Use the options --iterations --threads");
+                exit(1);
+                break;
+        }
+    }
+    // before the log writer thread starts, so SIGUSR1 is blocked in every thread
+    if(metrics_start(metrics_socket) != 0) {
+        exit(1);
+    }
+    if(log_name != NULL) {
+        if(log_open(log_name, log_commit_ms, log_fsync_policy, log_fsync_ms, log_max_size) != 0) {
+            exit(1);
+        }
+    } else {
+        fprintf(stderr, "You are required to give a log file \n");
+        exit(1);
+    }
+
+    if(host == NULL) {
+        fprintf(stderr, "You are required to give a host \n");
+        exit(1);
+    }
+
+    if(id == -1) {
+        fprintf(stderr, "You are required to give a ID number \n");
+        exit(1);
+    }
+
+    // --host=unix:PATH talks to a local socket whichever client was started
+    if(strncmp(host, "unix:", 5) == 0) {
+        transport = &local_transport;
+        host += 5;
+    }
+
+    if(optind  == (argc -1)) {
+        port_no = atoi(argv[(argc-1)]);
+    } else {
+        fprintf(stderr, "The wrong number of non-option arguments are given \n");
+        exit(1);
+    }
+    // DNS answers while the log, spool and sensor are set up
+    if(transport != &local_transport) endpoint_prefetch(host, port_no);
+
+    if(spool_name != NULL && spool_open(spool_name, spool_capacity, use_binary) != 0) {
+        exit(1);
+    }
+    if(history_name != NULL && history_open(history_name, history_records, num_channels) != 0) {
+        exit(1);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    thermistor_init(beta);
+    encoder_init(&encoder, id, num_channels);
+    encoder_init(&history_encoder, id, num_channels);
+    reducer_init(&reducer, num_channels);
+    reducer.window = window;
+    reducer.mode = reduce_mode;
+    reducer.deadband = deadband;
+    initalize_hardware(sensor_spec);
+
+    if(transport->init != NULL && transport->init() != 0) {
+        exit(1);
+    }
+
+    if(flush_ms > 0) {
+        flush_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if(flush_timer_fd == -1) {
+            fprintf(stderr, "Failed to create the flush timer \n");
+            exit(1);
+        }
+    }
+
+    if(use_compression) {
+        compress_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if(compress_timer_fd == -1 || compressor_init(&compressor) != 0) {
+            fprintf(stderr, "Failed to set up compression \n");
+            exit(1);
+        }
+    }
+
+    if(pipe(wake_fds) != 0) {
+        fprintf(stderr, "Failed to create the wakeup pipe \n");
+        exit(1);
+    }
+    fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+
+    sample_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    period_wake_fd = eventfd(0, EFD_NONBLOCK);
+    if(sample_timer_fd == -1 || period_wake_fd == -1) {
+        fprintf(stderr, "Failed to create the sampling timer \n");
+        exit(1);
+    }
+    // sampling starts before the first connect, reports taken while the server
+    // is unreachable go into the spool, or are dropped without one
+    if(ring_init(&samples) != 0) {
+        exit(1);
+    }
+    int rc = pthread_create(&report_thread, NULL, thread_report_action, NULL);
+    if(rc == 0) {
+        rc = pthread_create(&temp_thread, NULL, thread_temperature_action, NULL);
+        sampling = rc == 0;
+    }
+    if(rc != 0) {
+        fprintf(stderr, "Failed to initialize the pthread \n");
+        exit(1);
+    }
+
+    reconnect();
+
+    // the socket, the wakeup pipe, the button and the batch and compression flush timers, all in one poll
+    int nfds = 5;
+    struct pollfd poll_fds[nfds];
+
+    poll_fds[1].fd = wake_fds[0];
+    poll_fds[1].events = POLLIN;
+    poll_fds[2].fd = button_fd;
+    poll_fds[2].events = POLLIN;
+    poll_fds[3].fd = flush_timer_fd;
+    poll_fds[3].events = POLLIN;
+    poll_fds[4].fd = compress_timer_fd;
+    poll_fds[4].events = POLLIN;
+
+    while(1) {
+        if(!connected) {
+            reconnect();
+        }
+        poll_fds[0].fd = server.fd;
+        poll_fds[0].events = POLLIN | (write_blocked ? POLLOUT : 0);
+        // a HISTORY= reply carries on as soon as the socket has taken what is queued,
+        // a write waiting on either direction waits in poll instead of spinning
+        int ret = poll(poll_fds, nfds, history_replying && !write_blocked && !write_wants_read ? 0 : -1);
+        metric_add(METRIC_POLL_WAKEUPS, 1);
+        if (ret < 0) {
+            if(errno == EINTR) continue;
+            printf("Polling failed\r\n");
+            exit(1); 
+        }
+        if (poll_fds[1].revents & POLLIN) {
+            char wakeups[64];
+            while(read(wake_fds[0], wakeups, sizeof(wakeups)) > 0);
+        }
+        if (poll_fds[0].revents & POLLIN) {
+            if(read_commands() < 0) {
+                disconnect();
+                continue;
+            }
+        } else if (poll_fds[0].revents & POLLERR || poll_fds[0].revents & POLLHUP) {
+
+            printf("Polling failed");
+            disconnect();
+            continue;
+        }
+        if (poll_fds[3].revents & POLLIN) {
+            uint64_t expirations;
+            read(flush_timer_fd, &expirations, sizeof(expirations));
+            pthread_mutex_lock(&batch_lock);
+            if(batch_count > 0 && elapsed_ms(&batch_started) >= flush_ms - 1) flush_batch();
+            pthread_mutex_unlock(&batch_lock);
+        }
+        if (poll_fds[4].revents & POLLIN) {
+            uint64_t expirations;
+            read(compress_timer_fd, &expirations, sizeof(expirations));
+            pthread_mutex_lock(&out_lock);
+            compress_due = compress_held;
+            pthread_mutex_unlock(&out_lock);
+        }
+        if ((poll_fds[2].revents & POLLIN) && button_pressed(button_fd)) {
+            report_shutdown();
+            exit_flag = 1;
+            shutdown_program();
+        }
+        if(drain_output() < 0) {
+            disconnect();
+            continue;
+        }
+        if(refill_from_spool() < 0) {
+            disconnect();
+            continue;
+        }
+        drain_output();
+        pump_history();
+        drain_output();
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef LAB4C_H
+#define LAB4C_H
+
+#include "transport.h"
+
+/*
+ * The whole client: option parsing, the sampler thread, batching, the
+ * command handling and the event loop. lab4c_tcp and lab4c_tls only pick
+ * the transport.
+ */
+int lab4c_main(int argc, char *argv[], struct transport* transport);
+
+#endif
@@ -0,0 +1,813 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+
+#include "sensor.h"
+#include "thermistor.h"
+#include "logwriter.h"
+#include "format.h"
+#include "parser.h"
+#include "transport.h"
+#include "endpoint.h"
+#include "mux.h"
+
+/*
+ * Gateway mode: one process drives many devices. Each device is a session
+ * with its own ID=, scale, period and STOP/START state, and a timerfd for its
+ * sampling grid. Sessions are spread over a few worker threads, each running
+ * one epoll loop, instead of a process and two threads per device.
+ *
+ * A session normally has its own connection. With --mux each worker opens a
+ * single connection and its sessions become channels on it (see mux.h), so a
+ * thousand devices cost a handful of handshakes instead of a thousand.
+ *
+ * Connecting can take seconds (the address race, a TLS handshake), so it is
+ * done on CONNECTOR_THREADS threads of its own. A worker queues the link and
+ * carries on sampling its other sessions; the connector hands the link back
+ * through the worker's eventfd once it is open or has failed.
+ */
+
+#define SESSION_OUT_SIZE 4096
+#define MUX_OUT_SIZE (64 * 1024)
+#define MAX_WORKERS 64
+#define MIN_BACKOFF_MS 500
+#define MAX_BACKOFF_MS 60000
+#define MIN_PERIOD 0.001
+#define CONNECTOR_THREADS 4
+#define GREETING_MAX 32
+
+// what an epoll event is for, kept in the low bits of its data
+#define EVENT_SOCKET 0
+#define EVENT_TIMER 1
+#define EVENT_MUX 2
+#define EVENT_OPENED 3
+
+// A connection and the bytes still waiting to go out on it.
+struct link {
+    struct connection conn;
+    int connected;
+    char* out;
+    int out_size;
+    int out_len;
+    int write_retry_len;
+    int write_blocked;
+    int epoll_fd;
+    uint64_t tag;
+    int worker;
+    // set while a connector thread owns conn
+    int connecting;
+    int open_status;
+    char greeting[GREETING_MAX];
+    int greeting_len;
+    struct link* next_open;
+};
+
+struct session {
+    int id;
+    int index;
+    int worker;
+    int channel;
+    int online;
+    // its own connection, or with --mux only the output waiting for credit
+    struct link link;
+    int credit;
+    int backoff_ms;
+    long retry_at_ms;
+    struct line_parser parser;
+    int timer_fd;
+    double period;
+    int fahrenheit;
+    int stopped;
+    int done;
+    char out[SESSION_OUT_SIZE];
+};
+
+struct worker {
+    pthread_t thread;
+    int index;
+    int epoll_fd;
+    int live;
+    // the shared connection with --mux
+    struct link link;
+    struct mux_parser frames;
+    long retry_at_ms;
+    int backoff_ms;
+    // for the backoff jitter, rand is not safe across workers
+    unsigned int seed;
+    // links the connectors are done with, and the eventfd that says so
+    int opened_fd;
+    struct link* opened;
+    pthread_mutex_t opened_lock;
+    char out[MUX_OUT_SIZE];
+};
+
+struct transport* transport = &tcp_transport;
+char* host = NULL;
+int port_no = -1;
+int use_mux = 0;
+int first_id = -1;
+struct session* sessions = NULL;
+int num_sessions = 0;
+struct worker workers[MAX_WORKERS];
+int num_workers = 2;
+pthread_mutex_t sensor_lock = PTHREAD_MUTEX_INITIALIZER;
+// links waiting for a connector, oldest first
+pthread_mutex_t open_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t open_wanted = PTHREAD_COND_INITIALIZER;
+struct link* open_head = NULL;
+struct link* open_tail = NULL;
+__thread struct session* current_session = NULL;
+
+long monotonic_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+// The client's reconnect backoff: doubles from MIN_BACKOFF_MS up to MAX_BACKOFF_MS,
+// plus up to half again of jitter so a fleet does not retry in lockstep.
+// Returns when to try next.
+long backoff_retry_at(int* backoff_ms, unsigned int* seed) {
+    *backoff_ms = *backoff_ms == 0 ? MIN_BACKOFF_MS : *backoff_ms * 2;
+    if(*backoff_ms > MAX_BACKOFF_MS) *backoff_ms = MAX_BACKOFF_MS;
+    return monotonic_ms() + *backoff_ms + rand_r(seed) % (*backoff_ms / 2 + 1);
+}
+
+uint64_t event_tag(int index, int kind) {
+    return ((uint64_t) index << 2) | kind;
+}
+
+void link_init(struct link* link, char* out, int out_size, int worker, uint64_t tag) {
+    link->conn.fd = -1;
+    link->out = out;
+    link->out_size = out_size;
+    link->worker = worker;
+    link->epoll_fd = workers[worker].epoll_fd;
+    link->tag = tag;
+}
+
+void link_watch(struct link* link) {
+    struct epoll_event event;
+    event.events = EPOLLIN | (link->write_blocked ? EPOLLOUT : 0);
+    event.data.u64 = link->tag;
+    epoll_ctl(link->epoll_fd, EPOLL_CTL_MOD, link->conn.fd, &event);
+}
+
+// Queues the link for a connector. Its worker hears back through EVENT_OPENED.
+void link_open(struct link* link, const char* greeting, int length) {
+    memcpy(link->greeting, greeting, length);
+    link->greeting_len = length;
+    link->connecting = 1;
+    link->next_open = NULL;
+    pthread_mutex_lock(&open_lock);
+    if(open_tail != NULL) open_tail->next_open = link; else open_head = link;
+    open_tail = link;
+    pthread_cond_signal(&open_wanted);
+    pthread_mutex_unlock(&open_lock);
+}
+
+void* thread_connector_action() {
+    while(1) {
+        pthread_mutex_lock(&open_lock);
+        while(open_head == NULL) pthread_cond_wait(&open_wanted, &open_lock);
+        struct link* link = open_head;
+        open_head = link->next_open;
+        if(open_head == NULL) open_tail = NULL;
+        pthread_mutex_unlock(&open_lock);
+
+        link->open_status = transport->open(&link->conn, host, port_no, link->greeting, link->greeting_len);
+
+        struct worker* w = &workers[link->worker];
+        pthread_mutex_lock(&w->opened_lock);
+        link->next_open = w->opened;
+        w->opened = link;
+        pthread_mutex_unlock(&w->opened_lock);
+        uint64_t one = 1;
+        write(w->opened_fd, &one, sizeof(one));
+    }
+    return NULL;
+}
+
+// The connector is done with the link. Returns its status, with the socket
+// watched if it opened.
+int link_opened(struct link* link) {
+    link->connecting = 0;
+    if(link->open_status != 0) return -1;
+    link->connected = 1;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = link->tag;
+    epoll_ctl(link->epoll_fd, EPOLL_CTL_ADD, link->conn.fd, &event);
+    return 0;
+}
+
+void link_reset(struct link* link) {
+    link->out_len = 0;
+    link->write_retry_len = 0;
+    link->write_blocked = 0;
+}
+
+void link_close(struct link* link) {
+    if(!link->connected) return;
+    epoll_ctl(link->epoll_fd, EPOLL_CTL_DEL, link->conn.fd, NULL);
+    transport->close(&link->conn);
+    link->connected = 0;
+    link_reset(link);
+}
+
+int link_append(struct link* link, const char* data, int length) {
+    if(link->out_len + length > link->out_size) return -1;
+    memcpy(link->out + link->out_len, data, length);
+    link->out_len += length;
+    return 0;
+}
+
+// Writes what the socket takes. Returns -1 when the connection is gone.
+int link_drain(struct link* link) {
+    while(link->out_len > 0) {
+        int length = link->write_retry_len > 0 ? link->write_retry_len : link->out_len;
+        int written = transport->write(&link->conn, link->out, length);
+        if(written == TRANSPORT_WANT_WRITE || written == TRANSPORT_WANT_READ) {
+            link->write_retry_len = length;
+            if(!link->write_blocked && written == TRANSPORT_WANT_WRITE) {
+                link->write_blocked = 1;
+                link_watch(link);
+            }
+            return 0;
+        }
+        if(written < 0) return -1;
+        link->write_retry_len = 0;
+        memmove(link->out, link->out + written, link->out_len - written);
+        link->out_len -= written;
+    }
+    if(link->write_blocked) {
+        link->write_blocked = 0;
+        link_watch(link);
+    }
+    return 0;
+}
+
+void session_log(struct session* s, const char* line, int length) {
+    char buffer[COMMAND_LINE_MAX + 16];
+    int prefix = snprintf(buffer, sizeof(buffer), "%d ", s->id);
+    memcpy(buffer + prefix, line, length);
+    log_write(buffer, prefix + length);
+}
+
+void session_arm_timer(struct session* s) {
+    struct itimerspec spec;
+    int64_t period_ns = (int64_t) (s->period * 1000000000LL);
+    spec.it_interval.tv_sec = period_ns / 1000000000LL;
+    spec.it_interval.tv_nsec = period_ns % 1000000000LL;
+    // start right away, later ticks land on the period grid
+    spec.it_value.tv_sec = 0;
+    spec.it_value.tv_nsec = 1;
+    timerfd_settime(s->timer_fd, 0, &spec, NULL);
+}
+
+void session_drop(struct session* s) {
+    if(!s->online) return;
+    if(use_mux) {
+        link_reset(&s->link);
+    } else {
+        link_close(&s->link);
+    }
+    s->online = 0;
+    parser_reset(&s->parser);
+}
+
+void session_finish(struct session* s) {
+    struct worker* w = &workers[s->worker];
+    if(use_mux && s->online) {
+        char frame[MUX_HEADER_SIZE];
+        link_append(&w->link, frame, mux_encode(frame, s->id, MUX_CLOSE, NULL, 0));
+    }
+    session_drop(s);
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, s->timer_fd, NULL);
+    close(s->timer_fd);
+    s->timer_fd = -1;
+    w->live--;
+}
+
+void worker_drop(struct worker* w) {
+    link_close(&w->link);
+    for(int i = w->index; i < num_sessions; i += num_workers) {
+        session_drop(&sessions[i]);
+        if(sessions[i].done && sessions[i].timer_fd != -1) session_finish(&sessions[i]);
+    }
+}
+
+void worker_drain(struct worker* w) {
+    if(w->link.connected && link_drain(&w->link) < 0) worker_drop(w);
+}
+
+void worker_connect(struct worker* w) {
+    if(w->link.connecting || monotonic_ms() < w->retry_at_ms) return;
+    link_open(&w->link, MUX_GREETING, strlen(MUX_GREETING));
+}
+
+void worker_opened(struct worker* w) {
+    if(link_opened(&w->link) != 0) {
+        w->retry_at_ms = backoff_retry_at(&w->backoff_ms, &w->seed);
+        return;
+    }
+    w->backoff_ms = 0;
+    mux_parser_reset(&w->frames);
+}
+
+void session_online(struct session* s) {
+    char id_buffer[30];
+    snprintf(id_buffer, 30, "ID=%d\n", s->id);
+    s->online = 1;
+    s->backoff_ms = 0;
+    log_write(id_buffer, strlen(id_buffer));
+}
+
+// With --mux the channel opens at once if the worker's connection is up, and
+// the connection is started otherwise; the session tries again next tick.
+// Without, the session's own connection is queued for a connector.
+void session_connect(struct session* s) {
+    if(use_mux) {
+        struct worker* w = &workers[s->worker];
+        if(!w->link.connected) {
+            worker_connect(w);
+            return;
+        }
+        char frame[MUX_HEADER_SIZE];
+        if(link_append(&w->link, frame, mux_encode(frame, s->id, MUX_OPEN, NULL, 0)) != 0) {
+            s->retry_at_ms = backoff_retry_at(&s->backoff_ms, &w->seed);
+            return;
+        }
+        s->credit = MUX_INITIAL_CREDIT;
+        session_online(s);
+        return;
+    }
+    if(s->link.connecting) return;
+    char id_buffer[30];
+    snprintf(id_buffer, 30, "ID=%d\n", s->id);
+    link_open(&s->link, id_buffer, strlen(id_buffer));
+}
+
+void session_opened(struct session* s) {
+    if(link_opened(&s->link) != 0) {
+        s->retry_at_ms = backoff_retry_at(&s->backoff_ms, &workers[s->worker].seed);
+        return;
+    }
+    session_online(s);
+}
+
+// Takes back every link the connectors have finished with.
+void worker_take_opened(struct worker* w) {
+    uint64_t count;
+    read(w->opened_fd, &count, sizeof(count));
+    pthread_mutex_lock(&w->opened_lock);
+    struct link* link = w->opened;
+    w->opened = NULL;
+    pthread_mutex_unlock(&w->opened_lock);
+    while(link != NULL) {
+        struct link* next = link->next_open;
+        if((link->tag & 3) == EVENT_MUX) {
+            worker_opened(w);
+        } else {
+            session_opened(&sessions[link->tag >> 2]);
+        }
+        // nobody left to use it
+        if(w->live == 0) link_close(link);
+        link = next;
+    }
+}
+
+// Moves pending output into DATA frames on the worker's connection, as far as the channel's credit goes.
+void session_push_frames(struct session* s) {
+    struct worker* w = &workers[s->worker];
+    while(s->link.out_len > 0 && s->credit > 0) {
+        int chunk = s->link.out_len;
+        if(chunk > s->credit) chunk = s->credit;
+        if(chunk > MUX_MAX_PAYLOAD) chunk = MUX_MAX_PAYLOAD;
+        if(w->link.out_len + MUX_HEADER_SIZE + chunk > w->link.out_size) break;
+        w->link.out_len += mux_encode(w->link.out + w->link.out_len, s->id, MUX_DATA, s->link.out, chunk);
+        memmove(s->link.out, s->link.out + chunk, s->link.out_len - chunk);
+        s->link.out_len -= chunk;
+        s->credit -= chunk;
+    }
+    worker_drain(w);
+}
+
+void session_drain(struct session* s) {
+    if(s->online) {
+        if(use_mux) {
+            session_push_frames(s);
+        } else if(link_drain(&s->link) < 0) {
+            session_drop(s);
+        }
+    }
+    if(s->done && s->timer_fd != -1 && (s->link.out_len == 0 || !s->online)) {
+        session_finish(s);
+    }
+}
+
+void session_send(struct session* s, const char* data, int length) {
+    if(!s->online) return;
+    // when the server is not keeping up with this device, new reports are shed
+    link_append(&s->link, data, length);
+}
+
+void session_command(char* line, int length) {
+    struct session* s = current_session;
+    const char* argument = NULL;
+    enum command_id command = command_lookup(line, length, &argument);
+    if(command != COMMAND_UNKNOWN) {
+        line[length] = '\n';
+        session_log(s, line, length + 1);
+        line[length] = '\0';
+    }
+
+    switch(command) {
+        case COMMAND_PERIOD: {
+            double new_period = atof(argument);
+            if(new_period >= MIN_PERIOD) {
+                s->period = new_period;
+                session_arm_timer(s);
+            }
+            break;
+        }
+        case COMMAND_SCALE_C:
+            s->fahrenheit = 0;
+            break;
+        case COMMAND_SCALE_F:
+            s->fahrenheit = 1;
+            break;
+        case COMMAND_STOP:
+            s->stopped = 1;
+            break;
+        case COMMAND_START:
+            s->stopped = 0;
+            break;
+        case COMMAND_OFF: {
+            char shutdown_buffer[FORMAT_LINE_MAX];
+            int shutdown_length = format_shutdown(shutdown_buffer, time(0));
+            session_send(s, shutdown_buffer, shutdown_length);
+            session_log(s, shutdown_buffer, shutdown_length);
+            s->done = 1;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void session_readable(struct session* s) {
+    char read_buffer[4096];
+    current_session = s;
+    while(s->online && !s->done) {
+        int how_much_read = transport->read(&s->link.conn, read_buffer, sizeof(read_buffer));
+        if(how_much_read == TRANSPORT_WANT_READ) break;
+        if(how_much_read == TRANSPORT_WANT_WRITE) {
+            s->link.write_blocked = 1;
+            link_watch(&s->link);
+            break;
+        }
+        if(how_much_read < 0) {
+            session_drop(s);
+            break;
+        }
+        parser_feed(&s->parser, read_buffer, how_much_read, session_command);
+    }
+    session_drain(s);
+}
+
+void mux_frame(void* context, uint32_t channel, enum mux_type type, char* payload, int length) {
+    struct worker* w = context;
+    int64_t index = (int64_t) channel - first_id;
+    if(index < 0 || index >= num_sessions) return;
+    struct session* s = &sessions[index];
+    if(s->worker != w->index || !s->online) return;
+
+    switch(type) {
+        case MUX_DATA:
+            current_session = s;
+            parser_feed(&s->parser, payload, length, session_command);
+            session_drain(s);
+            break;
+        case MUX_CREDIT:
+            s->credit += mux_credit_increment(payload);
+            session_drain(s);
+            break;
+        case MUX_CLOSE:
+            // the server let go of this device, it opens the channel again after a backoff
+            session_drop(s);
+            s->retry_at_ms = backoff_retry_at(&s->backoff_ms, &w->seed);
+            if(s->done) session_finish(s);
+            break;
+        default:
+            break;
+    }
+}
+
+void worker_readable(struct worker* w) {
+    char read_buffer[16384];
+    while(w->link.connected) {
+        int how_much_read = transport->read(&w->link.conn, read_buffer, sizeof(read_buffer));
+        if(how_much_read == TRANSPORT_WANT_READ) break;
+        if(how_much_read == TRANSPORT_WANT_WRITE) {
+            w->link.write_blocked = 1;
+            link_watch(&w->link);
+            break;
+        }
+        if(how_much_read < 0 || mux_feed(&w->frames, read_buffer, how_much_read, mux_frame, w) < 0) {
+            worker_drop(w);
+            break;
+        }
+    }
+    worker_drain(w);
+}
+
+void session_tick(struct session* s) {
+    uint64_t expirations = 0;
+    if(read(s->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+
+    if(!s->online) {
+        if(monotonic_ms() >= s->retry_at_ms) session_connect(s);
+        if(!s->online) return;
+    }
+    if(s->stopped || s->done) return;
+
+    pthread_mutex_lock(&sensor_lock);
+    int raw = sensor->read_raw(s->channel);
+    pthread_mutex_unlock(&sensor_lock);
+    float temperature;
+    thermistor_convert(&raw, &temperature, 1, s->fahrenheit);
+
+    char buffer[FORMAT_LINE_MAX];
+    int length = format_report(buffer, time(0), &temperature, 1);
+    session_send(s, buffer, length);
+    session_log(s, buffer, length);
+    session_drain(s);
+}
+
+// Gives the shared connection up to two seconds to deliver the last SHUTDOWN and CLOSE frames.
+void worker_flush(struct worker* w) {
+    long deadline = monotonic_ms() + 2000;
+    while(w->link.connected && w->link.out_len > 0 && monotonic_ms() < deadline) {
+        struct pollfd fd = { w->link.conn.fd, POLLOUT | POLLIN, 0 };
+        poll(&fd, 1, 100);
+        worker_drain(w);
+    }
+    link_close(&w->link);
+}
+
+void* worker_action(void* arg) {
+    struct worker* w = arg;
+    struct epoll_event events[64];
+    while(w->live > 0) {
+        int ready = epoll_wait(w->epoll_fd, events, 64, -1);
+        if(ready < 0) {
+            if(errno == EINTR) continue;
+            fprintf(stderr, "epoll_wait failed %s \n", strerror(errno));
+            exit(1);
+        }
+        for(int i = 0; i < ready; i++) {
+            int kind = events[i].data.u64 & 3;
+            if(kind == EVENT_OPENED) {
+                worker_take_opened(w);
+                continue;
+            }
+            if(kind == EVENT_MUX) {
+                if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    worker_drop(w);
+                    continue;
+                }
+                if(events[i].events & EPOLLIN) worker_readable(w);
+                if(events[i].events & EPOLLOUT) worker_drain(w);
+                continue;
+            }
+            struct session* s = &sessions[events[i].data.u64 >> 2];
+            if(s->timer_fd == -1) continue;
+            if(kind == EVENT_TIMER) {
+                session_tick(s);
+            } else if(events[i].events & (EPOLLERR | EPOLLHUP)) {
+                session_drop(s);
+                if(s->done) session_finish(s);
+            } else {
+                if(events[i].events & EPOLLIN) session_readable(s);
+                if(s->online && (events[i].events & EPOLLOUT)) session_drain(s);
+            }
+        }
+    }
+    if(use_mux) worker_flush(w);
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+
+    srand(time(0));
+
+    int curr_option;
+    const struct option options[] = {
+        { "scale",  required_argument, NULL,  's' },
+        { "period", required_argument, NULL,  'p' },
+        { "log", required_argument, NULL, 'l'},
+        { "id", required_argument, NULL, 'i'},
+        { "devices", required_argument, NULL, 'n'},
+        { "workers", required_argument, NULL, 'w'},
+        { "host", required_argument, NULL, 'h'},
+        { "tls", no_argument, NULL, 't'},
+        { "mux", no_argument, NULL, 'm'},
+        { "sensor", required_argument, NULL, 'S'},
+        { "channels", required_argument, NULL, 'C'},
+        { "beta", required_argument, NULL, 'B'},
+        { "session-cache", required_argument, NULL, 'T'},
+        { "address-cache", required_argument, NULL, 'A'},
+        { 0, 0, 0, 0}
+    };
+
+    char* log_name = NULL;
+    double period = 1.0;
+    int fahrenheit = 1;
+    int beta = THERMISTOR_DEFAULT_BETA;
+    int channels[MAX_CHANNELS] = { 0 };
+    int num_channels = 1;
+    char* sensor_spec = "sim";
+    while((curr_option = getopt_long(argc, argv, "", options, NULL)) != -1)  {
+        switch(curr_option) {
+            case 's':
+                if(*optarg == 'F') {
+                    fahrenheit = 1;
+                } else if (*optarg == 'C') {
+                    fahrenheit = 0;
+                } else {
+                    fprintf(stderr, "You can only specify f or c for scale ");
+                    exit(1);
+                }
+                break;
+            case 'p':
+                period = atof(optarg);
+                if(period < MIN_PERIOD) {
+                    fprintf(stderr, "The period must be at least %g seconds \n", MIN_PERIOD);
+                    exit(1);
+                }
+                break;
+            case 'l':
+                log_name = optarg;
+                break;
+            case 'i':
+                first_id = atoi(optarg);
+                break;
+            case 'n':
+                num_sessions = atoi(optarg);
+                break;
+            case 'w':
+                num_workers = atoi(optarg);
+                if(num_workers < 1 || num_workers > MAX_WORKERS) {
+                    fprintf(stderr, "The number of workers must be between 1 and %d \n", MAX_WORKERS);
+                    exit(1);
+                }
+                break;
+            case 'h':
+                host = optarg;
+                break;
+            case 't':
+                transport = &tls_transport;
+                break;
+            case 'm':
+                use_mux = 1;
+                break;
+            case 'S':
+                sensor_spec = optarg;
+                break;
+            case 'C':
+                num_channels = sensor_parse_channels(optarg, channels);
+                if(num_channels == -1) {
+                    fprintf(stderr, "Channels must be a comma separated list of up to %d ADC channels from 0 to %d \n", MAX_CHANNELS, MAX_CHANNELS - 1);
+                    exit(1);
+                }
+                break;
+            case 'B':
+                beta = atoi(optarg);
+                if(beta <= 0) {
+                    fprintf(stderr, "The thermistor beta must be positive \n");
+                    exit(1);
+                }
+                break;
+            case 'T':
+                tls_transport.parse_option(curr_option, optarg);
+                break;
+            case 'A':
+                endpoint_set_cache(optarg);
+                break;
+            default:
+                fprintf(stderr, "Use the options --id --devices --host --log [--workers --tls --mux --period --scale --sensor] PORT\n");
+                exit(1);
+                break;
+        }
+    }
+
+    if(log_name == NULL || host == NULL || first_id == -1 || num_sessions < 1 || optind != argc - 1) {
+        fprintf(stderr, "Use the options --id --devices --host --log [--workers --tls --mux --period --scale --sensor] PORT\n");
+        exit(1);
+    }
+    port_no = atoi(argv[argc - 1]);
+    if(strncmp(host, "unix:", 5) == 0) {
+        transport = &local_transport;
+        host += 5;
+    } else {
+        endpoint_prefetch(host, port_no);
+    }
+    if(num_workers > num_sessions) num_workers = num_sessions;
+
+    if(log_open(log_name, 250, LOG_FSYNC_NEVER, 0, 0) != 0) {
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    // a socket and a timer per session
+    long fd_limit = raise_fd_limit(2L * num_sessions + 64);
+    if(fd_limit < 2L * num_sessions + 64) {
+        fprintf(stderr, "Only %ld files can be open, some of the %d devices will fail to connect \n", fd_limit, num_sessions);
+    }
+    thermistor_init(beta);
+    if(sensor_open(sensor_spec) != 0) {
+        exit(2);
+    }
+    if(transport->init != NULL && transport->init() != 0) {
+        exit(1);
+    }
+
+    for(int w = 0; w < num_workers; w++) {
+        workers[w].index = w;
+        workers[w].epoll_fd = epoll_create1(0);
+        workers[w].live = 0;
+        workers[w].seed = time(0) ^ (w * 7919);
+        link_init(&workers[w].link, workers[w].out, MUX_OUT_SIZE, w, event_tag(w, EVENT_MUX));
+        workers[w].opened_fd = eventfd(0, EFD_NONBLOCK);
+        pthread_mutex_init(&workers[w].opened_lock, NULL);
+        if(workers[w].epoll_fd == -1 || workers[w].opened_fd == -1) {
+            fprintf(stderr, "Failed to create the epoll fd %s \n", strerror(errno));
+            exit(1);
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = event_tag(w, EVENT_OPENED);
+        epoll_ctl(workers[w].epoll_fd, EPOLL_CTL_ADD, workers[w].opened_fd, &event);
+    }
+
+    sessions = calloc(num_sessions, sizeof(struct session));
+    if(sessions == NULL) {
+        fprintf(stderr, "Failed to allocate %d sessions \n", num_sessions);
+        exit(1);
+    }
+    for(int i = 0; i < num_sessions; i++) {
+        struct session* s = &sessions[i];
+        s->id = first_id + i;
+        s->index = i;
+        s->worker = i % num_workers;
+        s->channel = channels[i % num_channels];
+        link_init(&s->link, s->out, SESSION_OUT_SIZE, s->worker, event_tag(i, EVENT_SOCKET));
+        s->period = period;
+        s->fahrenheit = fahrenheit;
+        parser_reset(&s->parser);
+        s->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if(s->timer_fd == -1) {
+            fprintf(stderr, "Failed to create the timer for device %d %s \n", s->id, strerror(errno));
+            exit(1);
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = event_tag(i, EVENT_TIMER);
+        epoll_ctl(workers[s->worker].epoll_fd, EPOLL_CTL_ADD, s->timer_fd, &event);
+        workers[s->worker].live++;
+        session_arm_timer(s);
+    }
+
+    for(int c = 0; c < CONNECTOR_THREADS; c++) {
+        pthread_t connector;
+        if(pthread_create(&connector, NULL, thread_connector_action, NULL) != 0) {
+            fprintf(stderr, "Failed to initialize the pthread \n");
+            exit(1);
+        }
+        pthread_detach(connector);
+    }
+    for(int w = 0; w < num_workers; w++) {
+        if(pthread_create(&workers[w].thread, NULL, worker_action, &workers[w]) != 0) {
+            fprintf(stderr, "Failed to initialize the pthread \n");
+            exit(1);
+        }
+    }
+    for(int w = 0; w < num_workers; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+
+    sensor_close();
+    log_close();
+    return 0;
+}
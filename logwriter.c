@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "logwriter.h"
+
+#define LOG_RING_SIZE (64 * 1024)
+#define LOG_COMMIT_BYTES (8 * 1024)
+#define LOG_KEEP 3
+
+char log_ring[LOG_RING_SIZE];
+long log_head = 0;
+long log_used = 0;
+int log_closing = 0;
+// set while writes fail, so a full disk is reported once
+int log_failing = 0;
+int log_fd = -1;
+const char* log_path = NULL;
+long log_size = 0;
+long log_max_size = 0;
+int log_commit_ms = 250;
+int log_fsync_policy = LOG_FSYNC_NEVER;
+int log_fsync_ms = 0;
+struct timespec log_last_sync;
+pthread_t log_thread;
+pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t log_ready = PTHREAD_COND_INITIALIZER;
+pthread_cond_t log_space = PTHREAD_COND_INITIALIZER;
+
+int log_reopen() {
+    log_fd = open(log_path, O_CREAT | O_WRONLY | O_APPEND, S_IRWXU);
+    if(log_fd == -1) {
+        fprintf(stderr, "Opening the log file failed %s \n", strerror(errno));
+        return -1;
+    }
+    struct stat info;
+    log_size = fstat(log_fd, &info) == 0 ? info.st_size : 0;
+    return 0;
+}
+
+// FILE.2 -> FILE.3, FILE.1 -> FILE.2, FILE -> FILE.1, then start a fresh FILE.
+void log_rotate() {
+    char from[PATH_MAX];
+    char to[PATH_MAX];
+    for(int i = LOG_KEEP - 1; i >= 1; i--) {
+        snprintf(from, PATH_MAX, "%s.%d", log_path, i);
+        snprintf(to, PATH_MAX, "%s.%d", log_path, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, PATH_MAX, "%s.1", log_path);
+    fdatasync(log_fd);
+    close(log_fd);
+    rename(log_path, to);
+    if(log_reopen() != 0) {
+        log_fd = -1;
+    }
+}
+
+long log_elapsed_ms(struct timespec* since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+// Waits up to one commit interval for log_ready. Caller holds log_lock.
+void log_wait() {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += log_commit_ms / 1000;
+    deadline.tv_nsec += (log_commit_ms % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&log_ready, &log_lock, &deadline);
+}
+
+// Writes both parts, carrying on after EINTR and short writes. Returns how
+// many bytes made it, with *error set if a write failed before the end.
+long log_writev(struct iovec* parts, int count, int* error) {
+    long total = 0;
+    *error = 0;
+    while(count > 0) {
+        ssize_t written = writev(log_fd, parts, count);
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) {
+            *error = written < 0 ? errno : EIO;
+            break;
+        }
+        total += written;
+        while(count > 0 && (size_t) written >= parts[0].iov_len) {
+            written -= parts[0].iov_len;
+            parts++;
+            count--;
+        }
+        if(count > 0) {
+            parts[0].iov_base = (char*) parts[0].iov_base + written;
+            parts[0].iov_len -= written;
+        }
+    }
+    return total;
+}
+
+// Group commit: everything buffered goes out in one writev, with the ring's
+// wrapped tail as the second iovec. Only what was written leaves the ring, a
+// failed write is tried again after a commit interval.
+void* log_thread_action() {
+    pthread_mutex_lock(&log_lock);
+    while(1) {
+        if(log_used < LOG_COMMIT_BYTES && !log_closing) log_wait();
+        if(log_used == 0 && log_closing) break;
+        if(log_used == 0) continue;
+
+        struct iovec parts[2];
+        long first = LOG_RING_SIZE - log_head < log_used ? LOG_RING_SIZE - log_head : log_used;
+        parts[0].iov_base = log_ring + log_head;
+        parts[0].iov_len = first;
+        parts[1].iov_base = log_ring;
+        parts[1].iov_len = log_used - first;
+        long pending = log_used;
+        pthread_mutex_unlock(&log_lock);
+
+        // producers only fill the free part of the ring, so the committed bytes stay put
+        long done = pending;
+        int error = 0;
+        if(log_fd != -1) {
+            done = log_writev(parts, parts[1].iov_len > 0 ? 2 : 1, &error);
+            log_size += done;
+            if(log_fsync_policy == LOG_FSYNC_COMMIT ||
+               (log_fsync_policy == LOG_FSYNC_INTERVAL && log_elapsed_ms(&log_last_sync) >= log_fsync_ms)) {
+                fdatasync(log_fd);
+                clock_gettime(CLOCK_MONOTONIC, &log_last_sync);
+            }
+            if(log_max_size > 0 && log_size >= log_max_size) {
+                log_rotate();
+            }
+        }
+
+        pthread_mutex_lock(&log_lock);
+        if(error != 0) {
+            if(!log_failing) fprintf(stderr, "Writing the log failed %s, retrying \n", strerror(error));
+            log_failing = 1;
+            // a full ring would stall the report thread, and close must not wait forever
+            if(log_used == LOG_RING_SIZE || log_closing) {
+                fprintf(stderr, "Dropped %ld bytes of log output \n", pending - done);
+                done = pending;
+            }
+        } else if(log_failing) {
+            fprintf(stderr, "Writing the log works again \n");
+            log_failing = 0;
+        }
+        log_head = (log_head + done) % LOG_RING_SIZE;
+        log_used -= done;
+        pthread_cond_broadcast(&log_space);
+        if(error != 0 && !log_closing) log_wait();
+    }
+    pthread_mutex_unlock(&log_lock);
+    return NULL;
+}
+
+int log_open(const char* path, int commit_ms, int fsync_policy, int fsync_ms, long max_size) {
+    log_path = path;
+    log_commit_ms = commit_ms;
+    log_fsync_policy = fsync_policy;
+    log_fsync_ms = fsync_ms;
+    log_max_size = max_size;
+    if(log_reopen() != 0) return -1;
+    clock_gettime(CLOCK_MONOTONIC, &log_last_sync);
+
+    if(pthread_create(&log_thread, NULL, log_thread_action, NULL) != 0) {
+        fprintf(stderr, "Failed to initialize the log writer pthread \n");
+        return -1;
+    }
+    atexit(log_close);
+    return 0;
+}
+
+int log_parse_fsync(const char* policy, int* fsync_ms) {
+    if(strcmp(policy, "never") == 0) return LOG_FSYNC_NEVER;
+    if(strcmp(policy, "commit") == 0) return LOG_FSYNC_COMMIT;
+    *fsync_ms = atoi(policy);
+    return *fsync_ms > 0 ? LOG_FSYNC_INTERVAL : -1;
+}
+
+// Copies into the ring, waiting for the writer if the ring is full.
+void log_append(const char* data, int length) {
+    while(length > 0) {
+        while(log_used == LOG_RING_SIZE && !log_closing) {
+            pthread_cond_signal(&log_ready);
+            pthread_cond_wait(&log_space, &log_lock);
+        }
+        if(log_closing && log_used == LOG_RING_SIZE) return;
+        long tail = (log_head + log_used) % LOG_RING_SIZE;
+        long chunk = LOG_RING_SIZE - tail;
+        if(chunk > LOG_RING_SIZE - log_used) chunk = LOG_RING_SIZE - log_used;
+        if(chunk > length) chunk = length;
+        memcpy(log_ring + tail, data, chunk);
+        log_used += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+    if(log_used >= LOG_COMMIT_BYTES) {
+        pthread_cond_signal(&log_ready);
+    }
+}
+
+void log_write(const char* data, int length) {
+    if(log_path == NULL) return;
+    pthread_mutex_lock(&log_lock);
+    log_append(data, length);
+    pthread_mutex_unlock(&log_lock);
+}
+
+void log_line(const char* data, int length) {
+    if(log_path == NULL) return;
+    pthread_mutex_lock(&log_lock);
+    log_append(data, length);
+    log_append("\n", 1);
+    pthread_mutex_unlock(&log_lock);
+}
+
+void log_close() {
+    if(log_path == NULL) return;
+    pthread_mutex_lock(&log_lock);
+    if(log_closing) {
+        pthread_mutex_unlock(&log_lock);
+        return;
+    }
+    log_closing = 1;
+    pthread_cond_signal(&log_ready);
+    pthread_mutex_unlock(&log_lock);
+    pthread_join(log_thread, NULL);
+
+    if(log_fd != -1) {
+        if(log_fsync_policy != LOG_FSYNC_NEVER) fdatasync(log_fd);
+        close(log_fd);
+        log_fd = -1;
+    }
+}
@@ -0,0 +1,22 @@
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+
+#define LOG_FSYNC_NEVER 0
+#define LOG_FSYNC_COMMIT 1
+#define LOG_FSYNC_INTERVAL 2
+
+/*
+ * Buffers log lines in memory and lets a background thread write them out
+ * with writev once enough bytes have built up or the oldest line is
+ * commit_ms old. When max_size is non-zero the file rotates to FILE.1 ...
+ * FILE.3 as it grows past it. Everything still buffered is flushed at exit.
+ */
+int log_open(const char* path, int commit_ms, int fsync_policy, int fsync_ms, long max_size);
+// Parses never, commit or a millisecond interval for --log-fsync.
+int log_parse_fsync(const char* policy, int* fsync_ms);
+void log_write(const char* data, int length);
+// Writes data followed by a newline as one entry.
+void log_line(const char* data, int length);
+void log_close();
+
+#endif
@@ -0,0 +1,159 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+#include "transport.h"
+
+#define SUB_BUCKETS 4
+#define HISTOGRAM_BUCKETS (64 * SUB_BUCKETS)
+
+struct histogram {
+    atomic_long buckets[HISTOGRAM_BUCKETS];
+    atomic_long count;
+    atomic_long sum;
+    atomic_long max;
+};
+
+const char* counter_names[METRIC_COUNTERS] = {
+    "samples", "missed_deadlines", "overruns", "reports", "writes", "would_block",
+    "bytes_sent", "dropped_bytes", "poll_wakeups", "commands", "reconnects",
+};
+const char* histogram_names[METRIC_HISTOGRAMS] = {
+    "jitter_ns", "sensor_read_ns", "format_ns", "write_ns", "command_ns",
+};
+
+atomic_long counters[METRIC_COUNTERS];
+struct histogram histograms[METRIC_HISTOGRAMS];
+int metrics_listen_fd = -1;
+int metrics_signal_fd = -1;
+
+void metric_add(enum metric_counter counter, long value) {
+    atomic_fetch_add_explicit(&counters[counter], value, memory_order_relaxed);
+}
+
+// Values below 4 get a bucket each. Above that the top bit picks the power of two
+// and the two bits under it pick one of its four buckets.
+static inline int bucket_of(uint64_t value) {
+    if(value < SUB_BUCKETS) return value;
+    int top = 63 - __builtin_clzll(value);
+    return (top - 1) * SUB_BUCKETS + ((value >> (top - 2)) & (SUB_BUCKETS - 1));
+}
+
+static inline uint64_t bucket_floor(int bucket) {
+    if(bucket < SUB_BUCKETS) return bucket;
+    int top = bucket / SUB_BUCKETS + 1;
+    return (uint64_t) (SUB_BUCKETS + bucket % SUB_BUCKETS) << (top - 2);
+}
+
+void metric_record(enum metric_histogram which, int64_t ns) {
+    struct histogram* histogram = &histograms[which];
+    if(ns < 0) ns = 0;
+    atomic_fetch_add_explicit(&histogram->buckets[bucket_of(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, ns, memory_order_relaxed);
+    long max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+    while(ns > max && !atomic_compare_exchange_weak_explicit(&histogram->max, &max, ns, memory_order_relaxed, memory_order_relaxed));
+}
+
+// The lower bound of the bucket holding the given fraction of the samples.
+uint64_t percentile(const long* buckets, long count, double fraction) {
+    long wanted = count * fraction;
+    long seen = 0;
+    for(int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += buckets[b];
+        if(seen > wanted) return bucket_floor(b);
+    }
+    return 0;
+}
+
+int metrics_dump(char* out, int max) {
+    int length = 0;
+    for(int c = 0; c < METRIC_COUNTERS && length < max; c++) {
+        length += snprintf(out + length, max - length, "%s %ld\n", counter_names[c], atomic_load(&counters[c]));
+    }
+    for(int h = 0; h < METRIC_HISTOGRAMS && length < max; h++) {
+        long buckets[HISTOGRAM_BUCKETS];
+        long count = 0;
+        for(int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            buckets[b] = atomic_load_explicit(&histograms[h].buckets[b], memory_order_relaxed);
+            count += buckets[b];
+        }
+        long sum = atomic_load(&histograms[h].sum);
+        length += snprintf(out + length, max - length,
+                           "%s count=%ld mean=%ld p50=%lu p90=%lu p99=%lu p999=%lu max=%ld\n",
+                           histogram_names[h], count, count > 0 ? sum / count : 0,
+                           percentile(buckets, count, 0.5), percentile(buckets, count, 0.9),
+                           percentile(buckets, count, 0.99), percentile(buckets, count, 0.999),
+                           atomic_load(&histograms[h].max));
+    }
+    return length < max ? length : max;
+}
+
+void* thread_metrics_action() {
+    struct pollfd fds[2] = { { metrics_signal_fd, POLLIN, 0 }, { metrics_listen_fd, POLLIN, 0 } };
+    char dump[4096];
+    while(1) {
+        if(poll(fds, 2, -1) < 0) continue;
+        if(fds[0].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            read(metrics_signal_fd, &info, sizeof(info));
+            write_all(STDERR_FILENO, dump, metrics_dump(dump, sizeof(dump)));
+        }
+        if(fds[1].revents & POLLIN) {
+            int client = accept(metrics_listen_fd, NULL, NULL);
+            if(client >= 0) {
+                write_all(client, dump, metrics_dump(dump, sizeof(dump)));
+                close(client);
+            }
+        }
+    }
+    return NULL;
+}
+
+int metrics_start(const char* socket_path) {
+    sigset_t usr1;
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+    metrics_signal_fd = signalfd(-1, &usr1, 0);
+    if(metrics_signal_fd == -1) {
+        fprintf(stderr, "Failed to create the metrics signalfd %s \n", strerror(errno));
+        return -1;
+    }
+
+    if(socket_path != NULL) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if(strlen(socket_path) >= sizeof(address.sun_path)) {
+            fprintf(stderr, "The metrics socket path is too long \n");
+            return -1;
+        }
+        strcpy(address.sun_path, socket_path);
+        unlink(socket_path);
+        metrics_listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(metrics_listen_fd == -1
+           || bind(metrics_listen_fd, (struct sockaddr*) &address, sizeof(address)) < 0
+           || listen(metrics_listen_fd, 4) < 0) {
+            fprintf(stderr, "Failed to listen on the metrics socket %s %s \n", socket_path, strerror(errno));
+            return -1;
+        }
+    }
+
+    pthread_t metrics_thread;
+    if(pthread_create(&metrics_thread, NULL, thread_metrics_action, NULL) != 0) {
+        fprintf(stderr, "Failed to start the metrics thread \n");
+        return -1;
+    }
+    pthread_detach(metrics_thread);
+    return 0;
+}
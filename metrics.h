@@ -0,0 +1,46 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+enum metric_counter {
+    METRIC_SAMPLES,
+    METRIC_MISSED_DEADLINES,
+    METRIC_OVERRUNS,
+    METRIC_REPORTS,
+    METRIC_WRITES,
+    METRIC_WOULD_BLOCK,
+    METRIC_BYTES_SENT,
+    METRIC_DROPPED_BYTES,
+    METRIC_POLL_WAKEUPS,
+    METRIC_COMMANDS,
+    METRIC_RECONNECTS,
+    METRIC_COUNTERS,
+};
+
+enum metric_histogram {
+    // how late the acquisition thread woke up after its deadline
+    HISTOGRAM_JITTER,
+    HISTOGRAM_SENSOR_READ,
+    HISTOGRAM_FORMAT,
+    HISTOGRAM_WRITE,
+    HISTOGRAM_COMMAND,
+    METRIC_HISTOGRAMS,
+};
+
+/*
+ * Counters and latency histograms, cheap enough to leave on: a relaxed
+ * atomic add per event. Histograms are HDR style, each power of two of
+ * nanoseconds split into four buckets, so percentiles are within 25%.
+ *
+ * metrics_start blocks SIGUSR1 and starts a thread that dumps everything as
+ * text to stderr on SIGUSR1, and to anyone connecting to socket_path if one
+ * is given. Call it before any other thread is created so they all inherit
+ * the blocked signal.
+ */
+void metric_add(enum metric_counter counter, long value);
+void metric_record(enum metric_histogram histogram, int64_t ns);
+int metrics_dump(char* out, int max);
+int metrics_start(const char* socket_path);
+
+#endif
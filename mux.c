@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include "mux.h"
+
+void mux_put_u32(char* out, uint32_t value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+uint32_t mux_get_u32(const char* in) {
+    const unsigned char* bytes = (const unsigned char*) in;
+    return ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 8) | bytes[3];
+}
+
+int mux_encode(char* out, uint32_t channel, enum mux_type type, const char* payload, int length) {
+    mux_put_u32(out, channel);
+    out[4] = type;
+    out[5] = 0;
+    out[6] = length >> 8;
+    out[7] = length;
+    if(length > 0) memcpy(out + MUX_HEADER_SIZE, payload, length);
+    return MUX_HEADER_SIZE + length;
+}
+
+int mux_encode_credit(char* out, uint32_t channel, uint32_t increment) {
+    char payload[4];
+    mux_put_u32(payload, increment);
+    return mux_encode(out, channel, MUX_CREDIT, payload, 4);
+}
+
+uint32_t mux_credit_increment(const char* payload) {
+    return mux_get_u32(payload);
+}
+
+void mux_parser_reset(struct mux_parser* parser) {
+    parser->length = 0;
+}
+
+// Size of the frame starting at header, or -1 if it is not a valid frame.
+int mux_frame_size(const char* header) {
+    const unsigned char* bytes = (const unsigned char*) header;
+    int length = (bytes[6] << 8) | bytes[7];
+    if(bytes[4] < MUX_OPEN || bytes[4] > MUX_CLOSE || length > MUX_MAX_PAYLOAD) return -1;
+    if(bytes[4] == MUX_CREDIT && length != 4) return -1;
+    return MUX_HEADER_SIZE + length;
+}
+
+void mux_deliver(char* frame, mux_handler handler, void* context) {
+    int length = mux_frame_size(frame) - MUX_HEADER_SIZE;
+    handler(context, mux_get_u32(frame), (enum mux_type) (unsigned char) frame[4], frame + MUX_HEADER_SIZE, length);
+}
+
+int mux_feed(struct mux_parser* parser, char* data, int length, mux_handler handler, void* context) {
+    char* end = data + length;
+    while(data < end) {
+        if(parser->length == 0 && end - data >= MUX_HEADER_SIZE) {
+            int size = mux_frame_size(data);
+            if(size < 0) return -1;
+            if(end - data >= size) {
+                mux_deliver(data, handler, context);
+                data += size;
+                continue;
+            }
+        }
+
+        // a frame split across reads, collect the header first and then the rest
+        int wanted = MUX_HEADER_SIZE;
+        if(parser->length >= MUX_HEADER_SIZE) {
+            wanted = mux_frame_size(parser->frame);
+        }
+        int piece = wanted - parser->length;
+        if(piece > end - data) piece = end - data;
+        memcpy(parser->frame + parser->length, data, piece);
+        parser->length += piece;
+        data += piece;
+
+        if(parser->length == MUX_HEADER_SIZE && mux_frame_size(parser->frame) < 0) return -1;
+        if(parser->length >= MUX_HEADER_SIZE && parser->length == mux_frame_size(parser->frame)) {
+            mux_deliver(parser->frame, handler, context);
+            mux_parser_reset(parser);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+#ifndef MUX_H
+#define MUX_H
+
+#include <stdint.h>
+
+/*
+ * Multiplexed framing, so one connection can carry many device IDs. The
+ * client greets with MUX_GREETING instead of ID=, and from then on every
+ * byte in both directions is a frame:
+ *
+ *   4 bytes  channel (the device ID, big endian)
+ *   1 byte   type
+ *   1 byte   reserved, 0
+ *   2 bytes  payload length (big endian)
+ *
+ * OPEN and CLOSE start and end a channel. DATA carries the same lines the
+ * single device protocol does (reports up, commands down). Flow control is
+ * per channel: a channel starts with MUX_INITIAL_CREDIT bytes of DATA it may
+ * send, and the other side hands out more with CREDIT frames whose payload
+ * is a 4 byte increment.
+ */
+#define MUX_GREETING "MUX=1\n"
+#define MUX_HEADER_SIZE 8
+#define MUX_MAX_PAYLOAD 4096
+#define MUX_INITIAL_CREDIT 8192
+
+enum mux_type {
+    MUX_OPEN = 1,
+    MUX_DATA = 2,
+    MUX_CREDIT = 3,
+    MUX_CLOSE = 4,
+};
+
+// Writes one frame to out, which needs MUX_HEADER_SIZE + length bytes. Returns the frame size.
+int mux_encode(char* out, uint32_t channel, enum mux_type type, const char* payload, int length);
+int mux_encode_credit(char* out, uint32_t channel, uint32_t increment);
+uint32_t mux_credit_increment(const char* payload);
+
+/*
+ * Reassembles frames from a byte stream. Frames that arrive whole inside a
+ * read are handed over in place, like the line parser does.
+ */
+struct mux_parser {
+    char frame[MUX_HEADER_SIZE + MUX_MAX_PAYLOAD];
+    int length;
+};
+
+typedef void (*mux_handler)(void* context, uint32_t channel, enum mux_type type, char* payload, int length);
+
+void mux_parser_reset(struct mux_parser* parser);
+// Returns -1 on a frame the peer should not have sent (unknown type or oversized payload).
+int mux_feed(struct mux_parser* parser, char* data, int length, mux_handler handler, void* context);
+
+#endif
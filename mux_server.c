@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "mux.h"
+#include "parser.h"
+#include "transport.h"
+
+/*
+ * Reference server for the multiplexed protocol, to run lab4c_gateway --mux
+ * against. Every report line is printed as "ID line", and OPEN and CLOSE as
+ * "ID OPEN" and "ID CLOSE". Lines typed on stdin as "ID COMMAND" are sent to
+ * that device, "* COMMAND" goes to every open device. Credit is handed back
+ * as soon as a DATA frame has been printed.
+ */
+
+#define MAX_CLIENTS 1024
+#define CHANNEL_BUCKETS 4096
+
+struct client {
+    int fd;
+    SSL* ssl;
+    // how many bytes of MUX_GREETING have arrived, it may come in pieces
+    int greeted;
+    struct mux_parser frames;
+};
+
+struct channel {
+    uint32_t id;
+    int client;
+    char line[COMMAND_LINE_MAX];
+    int length;
+    struct channel* next;
+};
+
+struct client clients[MAX_CLIENTS];
+struct pollfd fds[MAX_CLIENTS + 2];
+int num_clients = 0;
+struct channel* buckets[CHANNEL_BUCKETS];
+SSL_CTX* server_ctx = NULL;
+int initial_credit = 0;
+
+struct channel** channel_slot(uint32_t id) {
+    struct channel** slot = &buckets[id % CHANNEL_BUCKETS];
+    while(*slot != NULL && (*slot)->id != id) slot = &(*slot)->next;
+    return slot;
+}
+
+int client_send(struct client* c, const char* data, int length) {
+    if(c->ssl != NULL) {
+        return SSL_write(c->ssl, data, length) == length ? 0 : -1;
+    }
+    return write_all(c->fd, data, length);
+}
+
+void channel_close(struct channel** slot) {
+    struct channel* channel = *slot;
+    printf("%u CLOSE\n", channel->id);
+    *slot = channel->next;
+    free(channel);
+}
+
+void client_close(int index) {
+    for(int b = 0; b < CHANNEL_BUCKETS; b++) {
+        struct channel** slot = &buckets[b];
+        while(*slot != NULL) {
+            if((*slot)->client == index) {
+                channel_close(slot);
+            } else {
+                slot = &(*slot)->next;
+            }
+        }
+    }
+    if(clients[index].ssl != NULL) {
+        SSL_shutdown(clients[index].ssl);
+        SSL_free(clients[index].ssl);
+    }
+    close(clients[index].fd);
+    clients[index].fd = -1;
+    fds[index + 2].fd = -1;
+}
+
+void on_frame(void* context, uint32_t id, enum mux_type type, char* payload, int length) {
+    int index = (struct client*) context - clients;
+    struct channel** slot = channel_slot(id);
+    struct channel* channel = *slot;
+
+    switch(type) {
+        case MUX_OPEN:
+            if(channel == NULL) {
+                channel = calloc(1, sizeof(struct channel));
+                channel->id = id;
+                *slot = channel;
+            }
+            channel->client = index;
+            channel->length = 0;
+            printf("%u OPEN\n", id);
+            if(initial_credit > 0) {
+                char frame[MUX_HEADER_SIZE + 4];
+                client_send(&clients[index], frame, mux_encode_credit(frame, id, initial_credit));
+            }
+            break;
+        case MUX_DATA: {
+            if(channel == NULL || channel->client != index) break;
+            for(int i = 0; i < length; i++) {
+                if(payload[i] == '\n') {
+                    printf("%u %.*s\n", id, channel->length, channel->line);
+                    channel->length = 0;
+                } else if(channel->length < COMMAND_LINE_MAX) {
+                    channel->line[channel->length++] = payload[i];
+                }
+            }
+            char frame[MUX_HEADER_SIZE + 4];
+            client_send(&clients[index], frame, mux_encode_credit(frame, id, length));
+            break;
+        }
+        case MUX_CLOSE:
+            if(channel != NULL && channel->client == index) channel_close(slot);
+            break;
+        default:
+            break;
+    }
+}
+
+void client_readable(int index) {
+    struct client* c = &clients[index];
+    char buffer[16384];
+    do {
+        int how_much_read;
+        if(c->ssl != NULL) {
+            how_much_read = SSL_read(c->ssl, buffer, sizeof(buffer));
+        } else {
+            how_much_read = read(c->fd, buffer, sizeof(buffer));
+        }
+        if(how_much_read <= 0) {
+            client_close(index);
+            return;
+        }
+
+        char* data = buffer;
+        int greeting_length = strlen(MUX_GREETING);
+        if(c->greeted < greeting_length) {
+            int piece = greeting_length - c->greeted < how_much_read ? greeting_length - c->greeted : how_much_read;
+            if(memcmp(data, MUX_GREETING + c->greeted, piece) != 0) {
+                fprintf(stderr, "Client did not greet with %s", MUX_GREETING);
+                client_close(index);
+                return;
+            }
+            c->greeted += piece;
+            data += piece;
+            how_much_read -= piece;
+        }
+        if(mux_feed(&c->frames, data, how_much_read, on_frame, c) < 0) {
+            fprintf(stderr, "Client sent a malformed frame \n");
+            client_close(index);
+            return;
+        }
+    } while(c->ssl != NULL && SSL_pending(c->ssl) > 0);
+}
+
+void send_command(struct channel* channel, const char* command, int length) {
+    char frame[MUX_HEADER_SIZE + COMMAND_LINE_MAX + 1];
+    char payload[COMMAND_LINE_MAX + 1];
+    memcpy(payload, command, length);
+    payload[length] = '\n';
+    client_send(&clients[channel->client], frame, mux_encode(frame, channel->id, MUX_DATA, payload, length + 1));
+}
+
+void stdin_command(char* line, int length) {
+    char* space = memchr(line, ' ', length);
+    if(space == NULL) return;
+    char* command = space + 1;
+    int command_length = line + length - command;
+    if(line[0] == '*') {
+        for(int b = 0; b < CHANNEL_BUCKETS; b++) {
+            for(struct channel* channel = buckets[b]; channel != NULL; channel = channel->next) {
+                send_command(channel, command, command_length);
+            }
+        }
+        return;
+    }
+    struct channel* channel = *channel_slot(strtoul(line, NULL, 10));
+    if(channel != NULL) send_command(channel, command, command_length);
+}
+
+int main(int argc, char *argv[]) {
+    const struct option options[] = {
+        { "cert", required_argument, NULL, 'c'},
+        { "key", required_argument, NULL, 'k'},
+        { "credit", required_argument, NULL, 'r'},
+        { 0, 0, 0, 0}
+    };
+    char* cert = NULL;
+    char* key = NULL;
+    int curr_option;
+    while((curr_option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch(curr_option) {
+            case 'c':
+                cert = optarg;
+                break;
+            case 'k':
+                key = optarg;
+                break;
+            case 'r':
+                initial_credit = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Use the options [--cert=FILE --key=FILE --credit=BYTES] PORT\n");
+                exit(1);
+        }
+    }
+    if(optind != argc - 1 || (cert == NULL) != (key == NULL)) {
+        fprintf(stderr, "Use the options [--cert=FILE --key=FILE --credit=BYTES] PORT\n");
+        exit(1);
+    }
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if(cert != NULL) {
+        server_ctx = SSL_CTX_new(TLS_server_method());
+        if(server_ctx == NULL
+           || SSL_CTX_use_certificate_chain_file(server_ctx, cert) != 1
+           || SSL_CTX_use_PrivateKey_file(server_ctx, key, SSL_FILETYPE_PEM) != 1) {
+            fprintf(stderr, "Failed to load the certificate and key\n");
+            ERR_print_errors_fp(stderr);
+            exit(1);
+        }
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(atoi(argv[optind]));
+    if(bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) < 0 || listen(listen_fd, 128) < 0) {
+        fprintf(stderr, "Failed to listen on port %s %s \n", argv[optind], strerror(errno));
+        exit(1);
+    }
+
+    struct line_parser commands;
+    parser_reset(&commands);
+    fds[0].fd = listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = STDIN_FILENO;
+    fds[1].events = POLLIN;
+
+    while(1) {
+        if(poll(fds, num_clients + 2, -1) < 0) {
+            if(errno == EINTR) continue;
+            fprintf(stderr, "poll failed %s \n", strerror(errno));
+            exit(1);
+        }
+        if(fds[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            int index = 0;
+            while(index < num_clients && clients[index].fd != -1) index++;
+            if(fd >= 0 && index < MAX_CLIENTS) {
+                struct client* c = &clients[index];
+                memset(c, 0, sizeof(*c));
+                c->fd = fd;
+                if(server_ctx != NULL) {
+                    c->ssl = SSL_new(server_ctx);
+                    SSL_set_fd(c->ssl, fd);
+                    if(SSL_accept(c->ssl) != 1) {
+                        SSL_free(c->ssl);
+                        close(fd);
+                        c->fd = -1;
+                        continue;
+                    }
+                }
+                fds[index + 2].fd = fd;
+                fds[index + 2].events = POLLIN;
+                if(index == num_clients) num_clients++;
+            } else if(fd >= 0) {
+                close(fd);
+            }
+        }
+        if(fds[1].revents & (POLLIN | POLLHUP)) {
+            char buffer[4096];
+            int how_much_read = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if(how_much_read <= 0) {
+                fds[1].fd = -1;
+            } else {
+                parser_feed(&commands, buffer, how_much_read, stdin_command);
+            }
+        }
+        for(int i = 0; i < num_clients; i++) {
+            if(clients[i].fd != -1 && (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR))) {
+                client_readable(i);
+            }
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "parser.h"
+
+void parser_reset(struct line_parser* parser) {
+    parser->length = 0;
+    parser->overflowed = 0;
+}
+
+void parser_feed(struct line_parser* parser, char* data, int length, line_handler handler) {
+    char* end = data + length;
+    while(data < end) {
+        char* newline = memchr(data, '\n', end - data);
+        int piece = (newline == NULL ? end : newline) - data;
+
+        if(parser->length + piece >= COMMAND_LINE_MAX) {
+            parser->overflowed = 1;
+        } else if(newline != NULL && parser->length == 0 && !parser->overflowed) {
+            *newline = '\0';
+            handler(data, piece);
+        } else if(!parser->overflowed) {
+            memcpy(parser->line + parser->length, data, piece);
+            parser->length += piece;
+        }
+
+        if(newline == NULL) return;
+        if(parser->length > 0 && !parser->overflowed) {
+            parser->line[parser->length] = '\0';
+            handler(parser->line, parser->length);
+        }
+        parser_reset(parser);
+        data = newline + 1;
+    }
+}
+
+struct command {
+    const char* text;
+    int length;
+    // commands with a value need at least this many bytes, 0 means an exact match
+    int min_length;
+    enum command_id id;
+};
+
+// Grouped by first byte so a line is compared against at most three names.
+const struct command commands_b[] = { { "BATCH=", 6, 7, COMMAND_BATCH }, { 0, 0, 0, 0 } };
+const struct command commands_d[] = { { "DEADBAND=", 9, 10, COMMAND_DEADBAND }, { 0, 0, 0, 0 } };
+const struct command commands_h[] = { { "HISTORY=", 8, 9, COMMAND_HISTORY }, { 0, 0, 0, 0 } };
+const struct command commands_l[] = { { "LOG", 3, 3, COMMAND_LOG }, { 0, 0, 0, 0 } };
+const struct command commands_o[] = { { "OFF", 3, 0, COMMAND_OFF }, { 0, 0, 0, 0 } };
+const struct command commands_p[] = { { "PERIOD=", 7, 8, COMMAND_PERIOD }, { 0, 0, 0, 0 } };
+const struct command commands_r[] = { { "REDUCE=", 7, 8, COMMAND_REDUCE }, { 0, 0, 0, 0 } };
+const struct command commands_s[] = {
+    { "SCALE=F", 7, 0, COMMAND_SCALE_F },
+    { "SCALE=C", 7, 0, COMMAND_SCALE_C },
+    { "STOP", 4, 0, COMMAND_STOP },
+    { "START", 5, 0, COMMAND_START },
+    { 0, 0, 0, 0 }
+};
+const struct command commands_w[] = { { "WINDOW=", 7, 8, COMMAND_WINDOW }, { 0, 0, 0, 0 } };
+
+enum command_id command_lookup(const char* line, int length, const char** argument) {
+    const struct command* candidates;
+    if(length <= 2) return COMMAND_UNKNOWN;
+    switch(line[0]) {
+        case 'B': candidates = commands_b; break;
+        case 'D': candidates = commands_d; break;
+        case 'H': candidates = commands_h; break;
+        case 'L': candidates = commands_l; break;
+        case 'O': candidates = commands_o; break;
+        case 'P': candidates = commands_p; break;
+        case 'R': candidates = commands_r; break;
+        case 'S': candidates = commands_s; break;
+        case 'W': candidates = commands_w; break;
+        default: return COMMAND_UNKNOWN;
+    }
+    for(; candidates->text != NULL; candidates++) {
+        int matches = candidates->min_length ? length >= candidates->min_length : length == candidates->length;
+        if(matches && memcmp(line, candidates->text, candidates->length) == 0) {
+            *argument = line + candidates->length;
+            return candidates->id;
+        }
+    }
+    return COMMAND_UNKNOWN;
+}
@@ -0,0 +1,42 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#define COMMAND_LINE_MAX 256
+
+enum command_id {
+    COMMAND_UNKNOWN,
+    COMMAND_SCALE_F,
+    COMMAND_SCALE_C,
+    COMMAND_PERIOD,
+    COMMAND_BATCH,
+    COMMAND_STOP,
+    COMMAND_START,
+    COMMAND_LOG,
+    COMMAND_OFF,
+    COMMAND_WINDOW,
+    COMMAND_REDUCE,
+    COMMAND_DEADBAND,
+    COMMAND_HISTORY,
+};
+
+/*
+ * Splits a byte stream into lines. Complete lines inside a read are handed
+ * over in place (the newline is replaced by a NUL), and only a line that is
+ * split across reads gets copied. A line longer than COMMAND_LINE_MAX is
+ * dropped up to its newline.
+ */
+struct line_parser {
+    char line[COMMAND_LINE_MAX];
+    int length;
+    int overflowed;
+};
+
+typedef void (*line_handler)(char* line, int length);
+
+void parser_reset(struct line_parser* parser);
+void parser_feed(struct line_parser* parser, char* data, int length, line_handler handler);
+
+// Finds the command on a line. For commands with a value, argument points at it.
+enum command_id command_lookup(const char* line, int length, const char** argument);
+
+#endif
@@ -0,0 +1,69 @@
+#include <math.h>
+#include <strings.h>
+
+#include "reduce.h"
+
+void reducer_init(struct reducer* reducer, int channels) {
+    reducer->window = 1;
+    reducer->mode = REDUCE_MEAN;
+    reducer->deadband = 0;
+    reducer->channels = channels;
+    reducer->samples = 0;
+    reducer->reports = 0;
+    reducer_reset(reducer);
+}
+
+void reducer_reset(struct reducer* reducer) {
+    reducer->count = 0;
+    reducer->have_sent = 0;
+}
+
+int reducer_add(struct reducer* reducer, const float* temperatures, float* out) {
+    int n = reducer->channels;
+    reducer->samples++;
+    for(int c = 0; c < n; c++) {
+        float value = temperatures[c];
+        if(reducer->count == 0) {
+            reducer->sum[c] = reducer->min[c] = reducer->max[c] = value;
+        } else {
+            reducer->sum[c] += value;
+            if(value < reducer->min[c]) reducer->min[c] = value;
+            if(value > reducer->max[c]) reducer->max[c] = value;
+        }
+        reducer->last[c] = value;
+    }
+    reducer->count++;
+    if(reducer->count < reducer->window) return 0;
+
+    enum reduce_mode mode = reducer->mode;
+    for(int c = 0; c < n; c++) {
+        switch(mode) {
+            case REDUCE_MEAN: out[c] = reducer->sum[c] / reducer->count; break;
+            case REDUCE_MIN: out[c] = reducer->min[c]; break;
+            case REDUCE_MAX: out[c] = reducer->max[c]; break;
+            case REDUCE_LAST: out[c] = reducer->last[c]; break;
+        }
+    }
+    reducer->count = 0;
+
+    float deadband = reducer->deadband;
+    if(deadband > 0 && reducer->have_sent) {
+        int moved = 0;
+        for(int c = 0; c < n; c++) {
+            if(fabsf(out[c] - reducer->sent[c]) > deadband) moved = 1;
+        }
+        if(!moved) return 0;
+    }
+    for(int c = 0; c < n; c++) reducer->sent[c] = out[c];
+    reducer->have_sent = 1;
+    reducer->reports++;
+    return 1;
+}
+
+int reduce_parse_mode(const char* text) {
+    if(strcasecmp(text, "MEAN") == 0) return REDUCE_MEAN;
+    if(strcasecmp(text, "MIN") == 0) return REDUCE_MIN;
+    if(strcasecmp(text, "MAX") == 0) return REDUCE_MAX;
+    if(strcasecmp(text, "LAST") == 0) return REDUCE_LAST;
+    return -1;
+}
@@ -0,0 +1,51 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <stdatomic.h>
+
+#include "sensor.h"
+
+enum reduce_mode {
+    REDUCE_MEAN,
+    REDUCE_MIN,
+    REDUCE_MAX,
+    // plain downsampling, the window's newest sample
+    REDUCE_LAST,
+};
+
+/*
+ * Edge reduction, so the device can sample fast and still send little.
+ * Every window samples collapse into one report holding the mean, min, max
+ * or last value of each channel. With a deadband, a report is only sent when
+ * some channel has moved more than deadband degrees since the last report
+ * that went out. window 1 with deadband 0 passes every sample through.
+ *
+ * The settings are atomic so the command handler can change them while the
+ * report thread runs, like the period and scale.
+ */
+struct reducer {
+    atomic_int window;
+    atomic_int mode;
+    _Atomic float deadband;
+
+    int channels;
+    int count;
+    float sum[MAX_CHANNELS];
+    float min[MAX_CHANNELS];
+    float max[MAX_CHANNELS];
+    float last[MAX_CHANNELS];
+    int have_sent;
+    float sent[MAX_CHANNELS];
+    long samples;
+    long reports;
+};
+
+void reducer_init(struct reducer* reducer, int channels);
+// Forgets the current window and deadband reference, e.g. after a scale change.
+void reducer_reset(struct reducer* reducer);
+// Adds a sample. Returns 1 with the values to report in out when a report is due.
+int reducer_add(struct reducer* reducer, const float* temperatures, float* out);
+// Parses MEAN, MIN, MAX or LAST. Returns -1 otherwise.
+int reduce_parse_mode(const char* text);
+
+#endif
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "ring.h"
+
+int ring_init(struct sample_ring* ring) {
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->sleeping, 0);
+    atomic_init(&ring->overruns, 0);
+    atomic_init(&ring->closed, 0);
+    ring->wake_fd = eventfd(0, 0);
+    if(ring->wake_fd == -1) {
+        fprintf(stderr, "Failed to create the sample ring eventfd %s \n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int ring_push(struct sample_ring* ring, const struct raw_sample* sample) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if(head - tail >= SAMPLE_RING_SIZE) {
+        atomic_fetch_add_explicit(&ring->overruns, 1, memory_order_relaxed);
+        return -1;
+    }
+    ring->slots[head % SAMPLE_RING_SIZE] = *sample;
+    // sequentially consistent, together with ring_wait's store and re-check one side always sees the other
+    atomic_store(&ring->head, head + 1);
+    if(atomic_exchange(&ring->sleeping, 0)) {
+        uint64_t one = 1;
+        write(ring->wake_fd, &one, sizeof(one));
+    }
+    return 0;
+}
+
+int ring_pop(struct sample_ring* ring, struct raw_sample* sample) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if(tail == head) return 0;
+    *sample = ring->slots[tail % SAMPLE_RING_SIZE];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+int ring_wait(struct sample_ring* ring) {
+    atomic_store(&ring->sleeping, 1);
+    if(atomic_load(&ring->closed)) return -1;
+    if(atomic_load(&ring->head) != atomic_load_explicit(&ring->tail, memory_order_relaxed)) {
+        atomic_store(&ring->sleeping, 0);
+        return 0;
+    }
+    uint64_t wakeups;
+    while(read(ring->wake_fd, &wakeups, sizeof(wakeups)) < 0 && errno == EINTR);
+    return atomic_load(&ring->closed) ? -1 : 0;
+}
+
+void ring_close(struct sample_ring* ring) {
+    atomic_store(&ring->closed, 1);
+    uint64_t one = 1;
+    write(ring->wake_fd, &one, sizeof(one));
+}
@@ -0,0 +1,47 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "sensor.h"
+
+#define SAMPLE_RING_SIZE 4096
+
+// One acquisition: the deadline it was taken for and the raw ADC values.
+struct raw_sample {
+    int64_t deadline_ns;
+    int raw[MAX_CHANNELS];
+};
+
+/*
+ * Single producer, single consumer ring of raw samples. The acquisition
+ * thread pushes and the report thread pops, and neither takes a lock, so a
+ * stalled sender can never delay the next ADC read. When the ring is full the
+ * new sample is dropped and counted as an overrun.
+ *
+ * The consumer sleeps on an eventfd. The producer only writes to it when the
+ * consumer has said it is going to sleep, so a busy ring costs no syscalls.
+ */
+struct sample_ring {
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    _Alignas(64) atomic_int sleeping;
+    atomic_long overruns;
+    atomic_int closed;
+    int wake_fd;
+    struct raw_sample slots[SAMPLE_RING_SIZE];
+};
+
+int ring_init(struct sample_ring* ring);
+// Producer side. Returns -1 and counts an overrun when the ring is full.
+int ring_push(struct sample_ring* ring, const struct raw_sample* sample);
+// Consumer side. Returns 1 with the oldest sample, 0 when empty.
+int ring_pop(struct sample_ring* ring, struct raw_sample* sample);
+// Consumer side. Blocks until the ring has something in it. Returns -1 once
+// the ring is closed.
+int ring_wait(struct sample_ring* ring);
+// Tells the consumer to stop, waking it if it is waiting.
+void ring_close(struct sample_ring* ring);
+
+#endif
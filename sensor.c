@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#ifndef LAB4C_NO_HARDWARE
+#include <rc/adc.h>
+#endif
+
+#include "sensor.h"
+
+#define ADC_MAX 4095
+
+struct sensor_backend* sensor = NULL;
+
+
+#ifndef LAB4C_NO_HARDWARE
+int rc_sensor_init(const char* arg) {
+    (void) arg;
+    if(rc_adc_init() == -1){
+        fprintf(stderr,"ERROR: failed to run rc_init_adc()\n");
+        return -1;
+    }
+    return 0;
+}
+
+int rc_sensor_read(int channel) {
+    return rc_adc_read_raw(channel);
+}
+
+void rc_sensor_cleanup() {
+    rc_adc_cleanup();
+}
+
+struct sensor_backend rc_sensor = { "rc", rc_sensor_init, rc_sensor_read, rc_sensor_cleanup, 1 };
+#endif
+
+
+// Synthetic thermistor: a slow sine wave around center with uniform noise.
+double sim_center = 2000;
+double sim_amplitude = 150;
+double sim_period = 60;
+double sim_noise = 4;
+struct timespec sim_start;
+
+int sim_sensor_init(const char* arg) {
+    if(arg != NULL && sscanf(arg, "%lf,%lf,%lf,%lf", &sim_center, &sim_amplitude, &sim_period, &sim_noise) < 1) {
+        fprintf(stderr, "The sim sensor takes center,amplitude,period,noise \n");
+        return -1;
+    }
+    if(sim_period <= 0) {
+        fprintf(stderr, "The sim sensor period must be positive \n");
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &sim_start);
+    srand(time(0) ^ getpid());
+    return 0;
+}
+
+int sim_sensor_read(int channel) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double t = (now.tv_sec - sim_start.tv_sec) + (now.tv_nsec - sim_start.tv_nsec) / 1e9;
+    double phase = 2 * M_PI * t / sim_period + channel;
+    double noise = sim_noise * (2.0 * rand() / RAND_MAX - 1.0);
+    int raw = (int) (sim_center + sim_amplitude * sin(phase) + noise);
+    if(raw < 1) raw = 1;
+    if(raw > ADC_MAX) raw = ADC_MAX;
+    return raw;
+}
+
+void sim_sensor_cleanup() {
+}
+
+struct sensor_backend sim_sensor = { "sim", sim_sensor_init, sim_sensor_read, sim_sensor_cleanup, 0 };
+
+
+// Replays raw readings from a file, one integer per line, looping at the end.
+int* replay_values = NULL;
+int replay_count = 0;
+int replay_next = 0;
+
+int replay_sensor_init(const char* arg) {
+    if(arg == NULL) {
+        fprintf(stderr, "The replay sensor needs a file, use --sensor=replay:FILE \n");
+        return -1;
+    }
+    FILE* file = fopen(arg, "r");
+    if(file == NULL) {
+        fprintf(stderr, "Opening the replay file %s failed \n", arg);
+        return -1;
+    }
+    int capacity = 1024;
+    replay_values = malloc(capacity * sizeof(int));
+    int value;
+    while(fscanf(file, "%d", &value) == 1) {
+        if(replay_count == capacity) {
+            capacity *= 2;
+            replay_values = realloc(replay_values, capacity * sizeof(int));
+        }
+        replay_values[replay_count++] = value;
+    }
+    fclose(file);
+    if(replay_count == 0) {
+        fprintf(stderr, "The replay file %s has no readings \n", arg);
+        return -1;
+    }
+    return 0;
+}
+
+int replay_sensor_read(int channel) {
+    (void) channel;
+    int value = replay_values[replay_next];
+    replay_next = (replay_next + 1) % replay_count;
+    return value;
+}
+
+void replay_sensor_cleanup() {
+    free(replay_values);
+    replay_values = NULL;
+}
+
+struct sensor_backend replay_sensor = { "replay", replay_sensor_init, replay_sensor_read, replay_sensor_cleanup, 0 };
+
+
+struct sensor_backend* backends[] = {
+#ifndef LAB4C_NO_HARDWARE
+    &rc_sensor,
+#endif
+    &sim_sensor,
+    &replay_sensor,
+};
+
+int sensor_open(const char* spec) {
+    const char* arg = strchr(spec, ':');
+    size_t name_length = arg == NULL ? strlen(spec) : (size_t)(arg - spec);
+    if(arg != NULL) arg++;
+
+    for(size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if(strlen(backends[i]->name) == name_length && strncmp(backends[i]->name, spec, name_length) == 0) {
+            if(backends[i]->init(arg) != 0) return -1;
+            sensor = backends[i];
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unknown sensor %s \n", spec);
+    return -1;
+}
+
+void sensor_close() {
+    if(sensor != NULL) sensor->cleanup();
+    sensor = NULL;
+}
+
+int sensor_parse_channels(const char* list, int* channels) {
+    int count = 0;
+    const char* cursor = list;
+    while(*cursor != '\0') {
+        char* end;
+        long channel = strtol(cursor, &end, 10);
+        if(end == cursor || channel < 0 || channel >= MAX_CHANNELS || count == MAX_CHANNELS) {
+            return -1;
+        }
+        channels[count++] = channel;
+        if(*end == ',') end++;
+        else if(*end != '\0') return -1;
+        cursor = end;
+    }
+    return count == 0 ? -1 : count;
+}
+
+void sensor_read_channels(const int* channels, int* raw, int n) {
+    for(int i = 0; i < n; i++) {
+        raw[i] = sensor->read_raw(channels[i]);
+    }
+}
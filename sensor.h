@@ -0,0 +1,30 @@
+#ifndef SENSOR_H
+#define SENSOR_H
+
+/*
+ * A source of raw 12-bit ADC readings. The clients only ever talk to the
+ * selected backend, so the same binary can sample the real thermistor or
+ * run without any hardware attached.
+ */
+struct sensor_backend {
+    const char* name;
+    int (*init)(const char* arg);
+    int (*read_raw)(int channel);
+    void (*cleanup)(void);
+    int has_hardware;
+};
+
+#define MAX_CHANNELS 8
+
+extern struct sensor_backend* sensor;
+
+// spec is "rc", "sim[:center,amplitude,period,noise]" or "replay:FILE". A replay
+// file is read in order, so with several channels each line holds one column per channel.
+int sensor_open(const char* spec);
+void sensor_close();
+
+// Parses a comma separated channel list such as "0,1,3". Returns the count or -1.
+int sensor_parse_channels(const char* list, int* channels);
+void sensor_read_channels(const int* channels, int* raw, int n);
+
+#endif
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spool.h"
+#include "encode.h"
+
+#define SPOOL_MAGIC "LAB4CSP1"
+// how stale the header may get; a crash can resend or lose this much of the spool's moves
+#define HEADER_SAVE_MS 250
+
+struct spool_header {
+    char magic[8];
+    uint64_t capacity;
+    uint64_t head;
+    uint64_t length;
+};
+
+int spool_fd = -1;
+int spool_binary = 0;
+struct spool_header spool;
+long header_saved_ms = 0;
+
+long spool_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+// A spool that can not be read or written is turned off, so reports go
+// straight to the queue instead of into a file that serves garbage.
+void spool_fail(const char* what) {
+    fprintf(stderr, "%s the spool failed %s, no longer spooling \n", what, strerror(errno));
+    close(spool_fd);
+    spool_fd = -1;
+    spool.length = 0;
+}
+
+// Reads or writes all of length bytes at a file offset. Returns -1 on failure.
+int spool_pio(char* buffer, long length, off_t file_offset, int writing) {
+    while(length > 0) {
+        ssize_t done = writing ? pwrite(spool_fd, buffer, length, file_offset) : pread(spool_fd, buffer, length, file_offset);
+        if(done < 0 && errno == EINTR) continue;
+        if(done <= 0) {
+            if(done == 0) errno = EIO;
+            return -1;
+        }
+        buffer += done;
+        file_offset += done;
+        length -= done;
+    }
+    return 0;
+}
+
+// The header is written at most every HEADER_SAVE_MS, or now if forced.
+int spool_save_header(int force) {
+    long now = spool_ms();
+    if(!force && now - header_saved_ms < HEADER_SAVE_MS) return 0;
+    if(spool_pio((char*) &spool, sizeof(spool), 0, 1) != 0) {
+        spool_fail("Writing the header of");
+        return -1;
+    }
+    header_saved_ms = now;
+    return 0;
+}
+
+// Reads or writes length bytes at ring offset position, wrapping at the end.
+// Turns the spool off and returns -1 on failure.
+int spool_io(char* buffer, long length, uint64_t position, int writing) {
+    while(length > 0) {
+        uint64_t offset = position % spool.capacity;
+        long chunk = spool.capacity - offset;
+        if(chunk > length) chunk = length;
+        if(spool_pio(buffer, chunk, sizeof(spool) + offset, writing) != 0) {
+            spool_fail(writing ? "Writing" : "Reading");
+            return -1;
+        }
+        buffer += chunk;
+        position += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+int spool_open(const char* path, long capacity, int binary) {
+    spool_binary = binary;
+    spool_fd = open(path, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+    if(spool_fd == -1) {
+        fprintf(stderr, "Opening the spool %s failed %s \n", path, strerror(errno));
+        return -1;
+    }
+
+    // pick up whatever a previous run left behind if the layout matches
+    if(pread(spool_fd, &spool, sizeof(spool), 0) == sizeof(spool) &&
+       memcmp(spool.magic, SPOOL_MAGIC, 8) == 0 && spool.capacity == (uint64_t) capacity) {
+        return 0;
+    }
+
+    memcpy(spool.magic, SPOOL_MAGIC, 8);
+    spool.capacity = capacity;
+    spool.head = 0;
+    spool.length = 0;
+    // allocated up front, so a full disk shows up here rather than as lost reports later
+    int status = ftruncate(spool_fd, 0) == 0 ? posix_fallocate(spool_fd, 0, sizeof(spool) + capacity) : errno;
+    if(status != 0) {
+        fprintf(stderr, "Sizing the spool %s failed %s \n", path, strerror(status));
+        close(spool_fd);
+        spool_fd = -1;
+        return -1;
+    }
+    return spool_save_header(1);
+}
+
+int spool_enabled() {
+    return spool_fd != -1;
+}
+
+long spool_size() {
+    return spool_fd == -1 ? 0 : (long) spool.length;
+}
+
+// Sets *boundary to where the first record that decodes at or after need
+// begins, the end of the spool if none does. The head can be mid-record after
+// a partial send, so the records are found the way the decoder resyncs rather
+// than by walking their lengths.
+int spool_record_boundary(long need, long* boundary) {
+    static char window[2 * ENCODE_RECORD_MAX + 64];
+    static struct decoded_record record;
+    long cursor = need;
+    while(cursor < (long) spool.length) {
+        long chunk = spool.length - cursor;
+        if(chunk > (long) sizeof(window)) chunk = sizeof(window);
+        if(spool_io(window, chunk, spool.head + cursor, 0) != 0) return -1;
+        long i;
+        for(i = 0; i < chunk; i++) {
+            if((unsigned char) window[i] != ENCODE_MAGIC) continue;
+            int used = decode_record(window + i, chunk - i, &record);
+            if(used > 0) {
+                *boundary = cursor + i;
+                return 0;
+            }
+            // cut off by the window, read again from here
+            if(used == 0 && i > 0 && cursor + chunk < (long) spool.length) break;
+        }
+        cursor += i;
+    }
+    *boundary = spool.length;
+    return 0;
+}
+
+// Drops at least need bytes from the head, rounded up to a line or record boundary.
+int spool_drop(long need) {
+    char buffer[512];
+    long dropped = 0;
+    if(spool_binary && spool_record_boundary(need, &dropped) != 0) return -1;
+    while(!spool_binary && dropped < (long) spool.length) {
+        long chunk = spool.length - dropped;
+        if(chunk > (long) sizeof(buffer)) chunk = sizeof(buffer);
+        if(spool_io(buffer, chunk, spool.head + dropped, 0) != 0) return -1;
+        long start = dropped < need ? need - dropped : 0;
+        if(start < chunk) {
+            char* newline = memchr(buffer + start, '\n', chunk - start);
+            if(newline != NULL) {
+                dropped += newline - buffer + 1;
+                break;
+            }
+        }
+        dropped += chunk;
+    }
+    spool.head = (spool.head + dropped) % spool.capacity;
+    spool.length -= dropped;
+    return 0;
+}
+
+int spool_append(const char* data, int length) {
+    if(spool_fd == -1) return -1;
+    if((uint64_t) length > spool.capacity) return -1;
+    if(spool.length + length > spool.capacity && spool_drop(spool.length + length - spool.capacity) != 0) return -1;
+    if(spool_io((char*) data, length, spool.head + spool.length, 1) != 0) return -1;
+    spool.length += length;
+    return spool_save_header(0);
+}
+
+int spool_peek(char* buffer, int max) {
+    long length = (long) spool.length < max ? (long) spool.length : max;
+    if(spool_fd == -1 || spool_io(buffer, length, spool.head, 0) != 0) return 0;
+    return length;
+}
+
+int spool_segment(off_t* offset, long* length) {
+    uint64_t start = spool.head % spool.capacity;
+    long to_end = spool.capacity - start;
+    *offset = sizeof(spool) + start;
+    *length = (long) spool.length < to_end ? (long) spool.length : to_end;
+    return spool_fd;
+}
+
+void spool_consume(long length) {
+    if(spool_fd == -1) return;
+    if(length > (long) spool.length) length = spool.length;
+    spool.head = (spool.head + length) % spool.capacity;
+    spool.length -= length;
+    spool_save_header(0);
+}
+
+void spool_close() {
+    if(spool_fd == -1) return;
+    if(spool_save_header(1) != 0) return;
+    close(spool_fd);
+    spool_fd = -1;
+}
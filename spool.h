@@ -0,0 +1,30 @@
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <sys/types.h>
+
+/*
+ * A bounded ring file that holds reports while the server is unreachable.
+ * When it fills up the oldest whole lines are dropped, or with binary set the
+ * oldest whole records. The spool is not locked internally, so callers must
+ * serialise access.
+ *
+ * The header is rewritten at most every HEADER_SAVE_MS rather than on every
+ * append, and on close. If the file can not be read or written the spool
+ * says so once and turns itself off: spool_append fails and the caller
+ * queues the reports itself.
+ */
+int spool_open(const char* path, long capacity, int binary);
+int spool_enabled();
+long spool_size();
+// Returns -1 if the spool is off or just failed.
+int spool_append(const char* data, int length);
+// Copies up to max bytes of the oldest data without consuming them.
+int spool_peek(char* buffer, int max);
+// The oldest data that is in one piece in the file, to send it straight
+// from there: returns the file with its offset and length.
+int spool_segment(off_t* offset, long* length);
+void spool_consume(long length);
+void spool_close();
+
+#endif
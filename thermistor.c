@@ -0,0 +1,31 @@
+#include <math.h>
+
+#include "thermistor.h"
+
+#define ADC_VALUES 4096
+
+float celsius_table[ADC_VALUES];
+float fahrenheit_table[ADC_VALUES];
+
+// R0 cancels out of log(R/R0), so only B changes the curve.
+void thermistor_init(int beta) {
+    for(int raw = 0; raw < ADC_VALUES; raw++) {
+        double R = 4095.0/raw-1.0;
+        double celcius = 1.0/(log(R)/beta+1/298.15)-273.15;
+        celsius_table[raw] = celcius;
+        fahrenheit_table[raw] = (celcius * (9.0/5.0)) + 32;
+    }
+}
+
+static inline int clamp_raw(int raw) {
+    if(raw < 0) return 0;
+    if(raw >= ADC_VALUES) return ADC_VALUES - 1;
+    return raw;
+}
+
+void thermistor_convert(const int* raw, float* out, int n, int fahrenheit) {
+    const float* table = fahrenheit ? fahrenheit_table : celsius_table;
+    for(int i = 0; i < n; i++) {
+        out[i] = table[clamp_raw(raw[i])];
+    }
+}
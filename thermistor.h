@@ -0,0 +1,12 @@
+#ifndef THERMISTOR_H
+#define THERMISTOR_H
+
+#define THERMISTOR_DEFAULT_BETA 4275
+
+// Precomputes the Celsius and Fahrenheit tables for every 12-bit ADC value.
+void thermistor_init(int beta);
+
+// Converts n raw ADC readings to temperatures in one pass.
+void thermistor_convert(const int* raw, float* out, int n, int fahrenheit);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <getopt.h>
+#include <sys/types.h>
+
+#define TRANSPORT_WANT_READ -2
+#define TRANSPORT_WANT_WRITE -3
+// sendfile on a connection that can not send from a file, the caller copies instead
+#define TRANSPORT_UNSUPPORTED -4
+
+struct connection {
+    int fd;
+    void* state;
+    // survives close so the next open can use it, e.g. a TLS session to resume
+    void* resume;
+};
+
+/*
+ * How the client core reaches the server. open connects and sends the
+ * greeting. Once it returns the fd is non-blocking, and read and write
+ * return TRANSPORT_WANT_READ or TRANSPORT_WANT_WRITE when they would block.
+ * -1 means the connection is gone. sendfile sends straight from a file
+ * the same way, or returns TRANSPORT_UNSUPPORTED.
+ */
+struct transport {
+    const char* name;
+    const struct option* options;
+    int (*parse_option)(int option, const char* arg);
+    int (*init)(void);
+    int (*open)(struct connection* conn, const char* host, int port, const char* greeting, int length);
+    int (*read)(struct connection* conn, char* buffer, int length);
+    int (*write)(struct connection* conn, const char* buffer, int length);
+    void (*close)(struct connection* conn);
+    int (*sendfile)(struct connection* conn, int fd, off_t offset, int length);
+};
+
+extern struct transport tcp_transport;
+extern struct transport tls_transport;
+extern struct transport local_transport;
+
+// Shared by the fd based transports.
+int tcp_connect(const char* host, int port);
+void set_nonblocking(int fd);
+// Lifts the open file limit towards wanted, as far as the hard limit allows. Returns the limit now in force.
+long raise_fd_limit(long wanted);
+int write_all(int fd, const char* buffer, int length);
+int stream_read(struct connection* conn, char* buffer, int length);
+int stream_write(struct connection* conn, const char* buffer, int length);
+void stream_close(struct connection* conn);
+int stream_sendfile(struct connection* conn, int fd, off_t offset, int length);
+
+#endif
@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "transport.h"
+
+// A Unix domain socket, used as --host=unix:PATH to take the network out of benchmarks.
+int local_open(struct connection* conn, const char* path, int port, const char* greeting, int length) {
+    (void) port;
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "The socket path %s is too long \n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    conn->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(conn->fd < 0) {
+        fprintf(stderr, "ERROR opening socket due to error %s \n", strerror(errno));
+        return -1;
+    }
+    if(connect(conn->fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+       write_all(conn->fd, greeting, length) != 0) {
+        fprintf(stderr, "ERROR connecting to %s due to error %s \n", path, strerror(errno));
+        stream_close(conn);
+        return -1;
+    }
+    set_nonblocking(conn->fd);
+    return 0;
+}
+
+struct transport local_transport = { "unix", NULL, NULL, NULL, local_open, stream_read, stream_write, stream_close, stream_sendfile };
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+
+#include "endpoint.h"
+#include "transport.h"
+
+int tcp_connect(const char* host, int port) {
+    return endpoint_connect(host, port);
+}
+
+void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+long raise_fd_limit(long wanted) {
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) != 0) return -1;
+    if(limit.rlim_cur < (rlim_t) wanted) {
+        limit.rlim_cur = limit.rlim_max != RLIM_INFINITY && limit.rlim_max < (rlim_t) wanted ? limit.rlim_max : (rlim_t) wanted;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        getrlimit(RLIMIT_NOFILE, &limit);
+    }
+    return limit.rlim_cur;
+}
+
+int write_all(int fd, const char* buffer, int length) {
+    while(length > 0) {
+        int written = write(fd, buffer, length);
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) return -1;
+        buffer += written;
+        length -= written;
+    }
+    return 0;
+}
+
+int stream_read(struct connection* conn, char* buffer, int length) {
+    while(1) {
+        int how_much_read = read(conn->fd, buffer, length);
+        if(how_much_read > 0) return how_much_read;
+        if(how_much_read < 0 && errno == EINTR) continue;
+        if(how_much_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return TRANSPORT_WANT_READ;
+        return -1;
+    }
+}
+
+int stream_write(struct connection* conn, const char* buffer, int length) {
+    while(1) {
+        int written = write(conn->fd, buffer, length);
+        if(written >= 0) return written;
+        if(errno == EINTR) continue;
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return TRANSPORT_WANT_WRITE;
+        fprintf(stderr, "Writing to the socket failed due to error %s \n", strerror(errno));
+        return -1;
+    }
+}
+
+int stream_sendfile(struct connection* conn, int fd, off_t offset, int length) {
+    while(1) {
+        int sent = sendfile(conn->fd, fd, &offset, length);
+        if(sent >= 0) return sent;
+        if(errno == EINTR) continue;
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return TRANSPORT_WANT_WRITE;
+        fprintf(stderr, "Sending from the file failed due to error %s \n", strerror(errno));
+        return -1;
+    }
+}
+
+void stream_close(struct connection* conn) {
+    if(conn->fd != -1) close(conn->fd);
+    conn->fd = -1;
+}
+
+int tcp_open(struct connection* conn, const char* host, int port, const char* greeting, int length) {
+    conn->fd = tcp_connect(host, port);
+    if(conn->fd == -1) return -1;
+    if(write_all(conn->fd, greeting, length) != 0) {
+        stream_close(conn);
+        return -1;
+    }
+    set_nonblocking(conn->fd);
+    return 0;
+}
+
+struct transport tcp_transport = { "tcp", NULL, NULL, NULL, tcp_open, stream_read, stream_write, stream_close, stream_sendfile };
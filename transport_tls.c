@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+
+#include <openssl/bio.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+
+#include "transport.h"
+
+// how long a server that took the TCP connection gets to finish the handshake
+#define HANDSHAKE_TIMEOUT_MS 5000
+
+SSL_CTX *ctx = NULL;
+char* session_cache = NULL;
+int use_early_data = 0;
+int use_ktls = 0;
+
+const struct option tls_options[] = {
+    { "session-cache", required_argument, NULL, 'T'},
+    { "early-data", no_argument, NULL, 'E'},
+    { "ktls", no_argument, NULL, 'K'},
+    { 0, 0, 0, 0}
+};
+
+int tls_parse_option(int option, const char* arg) {
+    switch(option) {
+        case 'T':
+            session_cache = (char*) arg;
+            return 0;
+        case 'E':
+            use_early_data = 1;
+            return 0;
+        case 'K':
+            use_ktls = 1;
+            return 0;
+    }
+    return -1;
+}
+
+// Keeps the newest session ticket on disk so the next run can resume instead of
+// doing a full handshake.
+int save_session(SSL* ssl, SSL_SESSION* session) {
+    (void) ssl;
+    char temp_name[PATH_MAX];
+    snprintf(temp_name, PATH_MAX, "%s.XXXXXX", session_cache);
+    // a temporary file of its own, the gateway's sessions all save to one cache at once.
+    // mkstemp makes it 0600, the ticket holds the resumption secret.
+    int fd = mkstemp(temp_name);
+    FILE* file = fd != -1 ? fdopen(fd, "w") : NULL;
+    if(file == NULL) {
+        if(fd != -1) {
+            close(fd);
+            unlink(temp_name);
+        }
+        fprintf(stderr, "Opening the session cache %s failed %s \n", temp_name, strerror(errno));
+        return 0;
+    }
+    int written = PEM_write_SSL_SESSION(file, session);
+    if(fclose(file) != 0) written = 0;
+    if(written) {
+        rename(temp_name, session_cache);
+    } else {
+        unlink(temp_name);
+    }
+    return 0;
+}
+
+SSL_SESSION* load_session() {
+    FILE* file = fopen(session_cache, "r");
+    if(file == NULL) return NULL;
+    SSL_SESSION* session = PEM_read_SSL_SESSION(file, NULL, NULL, NULL);
+    fclose(file);
+    if(session != NULL && !SSL_SESSION_is_resumable(session)) {
+        SSL_SESSION_free(session);
+        return NULL;
+    }
+    return session;
+}
+
+int tls_init() {
+    ctx = SSL_CTX_new(TLS_client_method());
+    if (ctx == NULL) {
+        fprintf(stderr, "Failed to create the SSL_CTX\n");
+        return -1;
+    }
+    
+
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+
+
+    if (!SSL_CTX_set_default_verify_paths(ctx)) {
+        fprintf(stderr, "Failed to set the default trusted certificate store\n");
+        return -1;
+    }
+
+    if (!SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION)) {
+        fprintf(stderr, "Failed to set the minimum TLS protocol version\n");
+        return -1;
+    }
+
+    if (use_early_data && session_cache == NULL) {
+        fprintf(stderr, "--early-data needs a --session-cache to resume from\n");
+        return -1;
+    }
+
+    
+    if(session_cache != NULL) {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, save_session);
+    }
+
+    // the kernel only does AEAD ciphers, so keep TLS 1.2 from picking anything else
+    if(use_ktls) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+        if (!SSL_CTX_set_cipher_list(ctx, "ECDHE+AESGCM:ECDHE+CHACHA20")) {
+            fprintf(stderr, "Failed to set the kTLS cipher list\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+long tls_ms() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+// For the handshake on the non-blocking socket: waits for the direction the
+// result asks for. Returns 0 to try again, -1 on failure or past the deadline.
+int tls_handshake_wait(SSL* ssl, int result, long deadline) {
+    int err = SSL_get_error(ssl, result);
+    if(err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) return -1;
+    struct pollfd wait = { SSL_get_fd(ssl), err == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT, 0 };
+    long left = deadline - tls_ms();
+    if(left <= 0 || poll(&wait, 1, left) <= 0) return -1;
+    return 0;
+}
+
+// Whether the kernel encrypts what is written to the socket.
+int ktls_sending(struct connection* conn) {
+    return use_ktls && BIO_get_ktls_send(SSL_get_wbio(conn->state));
+}
+
+int tls_open(struct connection* conn, const char* host, int port, const char* greeting, int length) {
+    SSL* ssl =  SSL_new(ctx);;
+    if (ssl == NULL) {
+        fprintf(stderr, "Failed to create the SSL object\n");
+        return -1;
+    }
+
+    SSL_SESSION* session = NULL;
+    if(session_cache != NULL) {
+        session = load_session();
+    } else if(conn->resume != NULL) {
+        session = conn->resume;
+        conn->resume = NULL;
+    }
+    if(session != NULL && !SSL_set_session(ssl, session)) {
+        SSL_SESSION_free(session);
+        session = NULL;
+    }
+
+    conn->fd = tcp_connect(host, port);
+    if(conn->fd == -1) {
+        SSL_free(ssl);
+        if(session != NULL) SSL_SESSION_free(session);
+        return -1;
+    }
+
+    BIO *bio = NULL;
+
+    /* Create a BIO to wrap the socket */
+    bio = BIO_new(BIO_s_socket());
+    if (bio == NULL) {
+        BIO_closesocket(conn->fd);
+        SSL_free(ssl);
+        if(session != NULL) SSL_SESSION_free(session);
+        return -1;
+    }
+
+    // non-blocking from here on, so a server that never answers the handshake runs into the deadline
+    set_nonblocking(conn->fd);
+    long deadline = tls_ms() + HANDSHAKE_TIMEOUT_MS;
+    BIO_set_fd(bio, conn->fd, BIO_CLOSE);
+    SSL_set_bio(ssl, bio, bio);
+    SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    conn->state = ssl;
+
+    if (!SSL_set_tlsext_host_name(ssl, host)) {
+        fprintf(stderr, "Failed to set the SNI hostname\n");
+        exit(1);
+    }
+
+    if (!SSL_set1_host(ssl, host)) {
+        fprintf(stderr, "Failed to set the certificate verification hostname\n");
+        exit(1);    
+    }
+
+
+    // with a resumable TLS 1.3 session the greeting can ride in the 0-RTT flight
+    int sent_early = 0;
+    if(use_early_data && session != NULL && SSL_SESSION_get_max_early_data(session) > 0) {
+        size_t written = 0;
+        while((sent_early = SSL_write_early_data(ssl, greeting, length, &written)) != 1
+              && tls_handshake_wait(ssl, sent_early, deadline) == 0);
+        sent_early = sent_early == 1;
+    }
+    if(session != NULL) SSL_SESSION_free(session);
+
+    int connected;
+    while((connected = SSL_connect(ssl)) < 1 && tls_handshake_wait(ssl, connected, deadline) == 0);
+    if (connected < 1) {
+        fprintf(stderr, "Failed to connect to the server\n");
+        SSL_free(ssl);
+        conn->state = NULL;
+        conn->fd = -1;
+        return -1;
+    } 
+
+    if(!sent_early || SSL_get_early_data_status(ssl) != SSL_EARLY_DATA_ACCEPTED) {
+        int written;
+        while((written = SSL_write(ssl, greeting, length)) <= 0 && tls_handshake_wait(ssl, written, deadline) == 0);
+        if(written <= 0) {
+            SSL_free(ssl);
+            conn->state = NULL;
+            conn->fd = -1;
+            return -1;
+        }
+    }
+
+    static int warned = 0;
+    if(use_ktls && !ktls_sending(conn) && !warned) {
+        fprintf(stderr, "Kernel TLS is not available (is the tls module loaded?), encrypting in userspace\n");
+        warned = 1;
+    }
+    return 0;
+}
+
+int tls_result(SSL* ssl, int result) {
+    if(result > 0) return result;
+    int err = SSL_get_error(ssl, result);
+    if(err == SSL_ERROR_WANT_READ) return TRANSPORT_WANT_READ;
+    if(err == SSL_ERROR_WANT_WRITE) return TRANSPORT_WANT_WRITE;
+    return -1;
+}
+
+int tls_read(struct connection* conn, char* buffer, int length) {
+    return tls_result(conn->state, SSL_read(conn->state, buffer, length));
+}
+
+int tls_write(struct connection* conn, const char* buffer, int length) {
+    // with kTLS a plain write is a TLS record, and there is no SSL_write retry rule
+    if(ktls_sending(conn)) return stream_write(conn, buffer, length);
+    int written = tls_result(conn->state, SSL_write(conn->state, buffer, length));
+    if(written == -1) fprintf(stderr, "SSL_write failed \n");
+    return written;
+}
+
+int tls_sendfile(struct connection* conn, int fd, off_t offset, int length) {
+    if(!ktls_sending(conn)) return TRANSPORT_UNSUPPORTED;
+    int sent = tls_result(conn->state, SSL_sendfile(conn->state, fd, offset, length, 0));
+    if(sent == -1) fprintf(stderr, "SSL_sendfile failed \n");
+    return sent;
+}
+
+void tls_close(struct connection* conn) {
+    SSL* ssl = conn->state;
+    if(ssl != NULL) {
+        // keep the session so the reconnect can resume it
+        if(session_cache == NULL) {
+            if(conn->resume != NULL) SSL_SESSION_free(conn->resume);
+            conn->resume = SSL_get1_session(ssl);
+        }
+        SSL_free(ssl);
+    }
+    conn->state = NULL;
+    conn->fd = -1;
+}
+
+struct transport tls_transport = { "tls", tls_options, tls_parse_option, tls_init, tls_open, tls_read, tls_write, tls_close, tls_sendfile };